@@ -0,0 +1,696 @@
+// Benchmark.cpp
+//
+// Micro and end-to-end benchmarks for the SoftRT hot path. Every case runs
+// once to warm up, then the requested number of timed repetitions; results
+// are written as JSON (to stdout unless --output is given) with per-op
+// percentiles across repetitions.
+// The sweep cases build point clouds of 10 to --max-spheres spheres (10^7 by
+// default) once each and report build time and scene memory alongside the
+// trace rate and the time to refit the hierarchy after the spheres move,
+// then rebuild and trace the hierarchy with the Morton builder, without and
+// with treelet restructuring. The mesh cases trace tori of about a thousand
+// and sixty-five thousand triangles. The frame cases move the camera a
+// little every repetition and compare retracing against reprojection. Usage:
+//   SoftRTBenchmark [--repetitions N] [--threads N] [--filter name] [--max-spheres N] [--output file.json]
+
+#include "Denoiser.h"
+#include "Renderer.h"
+#include "Mesh.h"
+#include "SphereSoA.h"
+#include "Temporal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+class BenchmarkResult
+{
+public:
+    std::string         name;
+    std::string         unit;
+    int                 sphereCount = 0;
+    int                 triangleCount = 0;
+    int                 width = 0;
+    int                 height = 0;
+    uint64_t            operations = 0; // Per repetition
+    size_t              memoryBytes = 0; // Scene memory, for cases that report it
+    std::vector<double> nsPerOp;        // One entry per repetition, sorted
+};
+
+class BenchmarkOptions
+{
+public:
+    int         repetitions = 10;
+    int         threadCount = 0;
+    const char* filter = nullptr;
+    int64_t     maxSpheres = 10000000;
+    const char* outputPath = nullptr;
+};
+
+// Keeps results observable so the optimizer cannot drop the measured work
+volatile float sink;
+
+double Percentile(const std::vector<double>& sorted, double percentile)
+{
+    size_t rank = static_cast<size_t>(percentile / 100.0 * sorted.size() + 0.999999);
+    rank = rank < 1 ? 1 : rank > sorted.size() ? sorted.size() : rank;
+    return sorted[rank - 1];
+}
+
+bool Selected(const BenchmarkOptions& options, const std::string& name)
+{
+    return !options.filter || name.find(options.filter) != std::string::npos;
+}
+
+void PrintResult(const BenchmarkResult& result)
+{
+    fprintf(stderr, "%-22s spheres=%-6d %4dx%-4d %10.2f ns/%s (p50) %10.3f M%ss/s",
+        result.name.c_str(), result.sphereCount, result.width, result.height,
+        Percentile(result.nsPerOp, 50.0), result.unit.c_str(), 1000.0 / Percentile(result.nsPerOp, 50.0), result.unit.c_str());
+    if (result.memoryBytes > 0)
+    {
+        fprintf(stderr, " %12.1f KiB", result.memoryBytes / 1024.0);
+    }
+    if (result.triangleCount > 0)
+    {
+        fprintf(stderr, " triangles=%d", result.triangleCount);
+    }
+    fprintf(stderr, "\n");
+}
+
+// Times body, which returns how many operations it performed
+bool Measure(const BenchmarkOptions& options, BenchmarkResult& result, const std::function<uint64_t()>& body)
+{
+    if (!Selected(options, result.name))
+    {
+        return false;
+    }
+
+    body();
+    for (int repetition = 0; repetition < options.repetitions; ++repetition)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t operations = body();
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        result.operations = operations;
+        result.nsPerOp.push_back(ns / static_cast<double>(operations > 0 ? operations : 1));
+    }
+    std::sort(result.nsPerOp.begin(), result.nsPerOp.end());
+    PrintResult(result);
+    return true;
+}
+
+void WriteJson(FILE* file, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results)
+{
+    fprintf(file, "{\n  \"kernel\": \"%s\",\n  \"threads\": %d,\n  \"repetitions\": %d,\n  \"benchmarks\": [\n",
+        SphereKernelName(), options.threadCount, options.repetitions);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult& result = results[i];
+        double sum = 0.0;
+        for (double ns : result.nsPerOp)
+        {
+            sum += ns;
+        }
+        double median = Percentile(result.nsPerOp, 50.0);
+
+        fprintf(file, "    {\"name\": \"%s\", \"unit\": \"%s\", \"spheres\": %d, \"width\": %d, \"height\": %d, \"operations\": %llu,\n",
+            result.name.c_str(), result.unit.c_str(), result.sphereCount, result.width, result.height,
+            static_cast<unsigned long long>(result.operations));
+        fprintf(file, "     \"ns_per_op\": {\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            result.nsPerOp.front(), sum / result.nsPerOp.size(), median,
+            Percentile(result.nsPerOp, 90.0), Percentile(result.nsPerOp, 99.0), result.nsPerOp.back());
+        if (result.memoryBytes > 0)
+        {
+            fprintf(file, "     \"memory_bytes\": %llu,\n", static_cast<unsigned long long>(result.memoryBytes));
+        }
+        if (result.triangleCount > 0)
+        {
+            fprintf(file, "     \"triangles\": %d,\n", result.triangleCount);
+        }
+        fprintf(file, "     \"ops_per_second\": %.1f}%s\n", 1.0e9 / median, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+// Camera rays over a width x height grid, matching Render()'s projection
+std::vector<Ray> CameraRays(int width, int height)
+{
+    Vector3 camPos{ 0.0f, 0.0f, -2.0f };
+    std::vector<Ray> rays;
+    rays.reserve(static_cast<size_t>(width) * height);
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            Vector3 nearPlanePos{ -1.0f + 2.0f * i / width, 1.0f - 2.0f * j / height, 0.0f };
+            rays.push_back(Ray{ camPos, nearPlanePos - camPos });
+        }
+    }
+    return rays;
+}
+
+// Shadow rays toward the key light from random points above the floor
+std::vector<Ray> ShadowRays(size_t count)
+{
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> x(-5.0f, 5.0f);
+    std::uniform_real_distribution<float> y(-1.0f, 5.0f);
+    std::uniform_real_distribution<float> z(0.0f, 10.0f);
+    Vector3 lightDirection = Vector3{ 1.0f, 1.0f, -1.0f }.Normalize();
+
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        rays.push_back(Ray{ Vector3{ x(generator), y(generator), z(generator) }, lightDirection });
+    }
+    return rays;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--repetitions") == 0 && hasValue)
+        {
+            options.repetitions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            options.threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-spheres") == 0 && hasValue)
+        {
+            options.maxSpheres = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+        {
+            options.outputPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--repetitions N] [--threads N] [--filter name] [--max-spheres N] [--output file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.repetitions <= 0)
+    {
+        fprintf(stderr, "Invalid repetition count %d\n", options.repetitions);
+        return 1;
+    }
+
+    std::vector<BenchmarkResult> results;
+    BenchmarkResult result;
+
+    // Vector3 arithmetic as used by shading: add, scale, normalize, dot
+    {
+        std::mt19937 generator(1);
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        std::vector<Vector3> vectors;
+        for (int i = 0; i < 1024; ++i)
+        {
+            vectors.push_back(Vector3{ value(generator), value(generator), value(generator) + 2.0f });
+        }
+
+        result = BenchmarkResult();
+        result.name = "vector3_ops";
+        result.unit = "op";
+        if (Measure(options, result, [&]()
+        {
+            const int kIterations = 1 << 20;
+            float sum = 0.0f;
+            for (int i = 0; i < kIterations; ++i)
+            {
+                const Vector3& a = vectors[i & 1023];
+                const Vector3& b = vectors[(i + 1) & 1023];
+                sum += ((a + b) * 0.5f).Normalize().Dot(a - b);
+            }
+            sink = sum;
+            return static_cast<uint64_t>(kIterations);
+        }))
+        {
+            results.push_back(result);
+        }
+    }
+
+    const int kSphereCounts[] = { 40, 1000, 10000 };
+    for (int sphereCount : kSphereCounts)
+    {
+        Scene scene;
+        BuildDefaultScene(scene, sphereCount);
+        std::vector<Ray> cameraRays = CameraRays(64, 64);
+        std::vector<Ray> shadowRays = ShadowRays(cameraRays.size());
+
+        // Scalar ray/sphere tests; one operation is one test
+        if (sphereCount <= 1000)
+        {
+            result = BenchmarkResult();
+            result.name = "intersect";
+            result.unit = "test";
+            result.sphereCount = sphereCount;
+            if (Measure(options, result, [&]()
+            {
+                uint64_t hits = 0;
+                for (const Ray& ray : cameraRays)
+                {
+                    HitRecord hit;
+                    for (const Sphere& sphere : scene.spheres)
+                    {
+                        hits += Intersect(ray, sphere, 0.0f, FLT_MAX, hit) ? 1 : 0;
+                    }
+                }
+                sink = static_cast<float>(hits);
+                return static_cast<uint64_t>(cameraRays.size() * scene.spheres.size());
+            }))
+            {
+                results.push_back(result);
+            }
+
+            // Wide kernel over the whole flat list; one operation is one ray
+            result = BenchmarkResult();
+            result.name = "intersect_wide";
+            result.unit = "ray";
+            result.sphereCount = sphereCount;
+            if (Measure(options, result, [&]()
+            {
+                float sum = 0.0f;
+                for (const Ray& ray : cameraRays)
+                {
+                    float tMax = FLT_MAX;
+                    sum += static_cast<float>(IntersectNearest(scene.bvh.leafSpheres, 0, scene.bvh.leafSpheres.count, ray, 0.0f, tMax));
+                }
+                sink = sum;
+                return static_cast<uint64_t>(cameraRays.size());
+            }))
+            {
+                results.push_back(result);
+            }
+        }
+
+        result = BenchmarkResult();
+        result.name = "trace_occlusion";
+        result.unit = "ray";
+        result.sphereCount = sphereCount;
+        if (Measure(options, result, [&]()
+        {
+            uint64_t occluded = 0;
+            for (const Ray& ray : shadowRays)
+            {
+                occluded += TraceRayOcclusion(ray, scene) ? 1 : 0;
+            }
+            sink = static_cast<float>(occluded);
+            return static_cast<uint64_t>(shadowRays.size());
+        }))
+        {
+            results.push_back(result);
+        }
+
+        // Full per-pixel path, including bounces and shadow rays
+        result = BenchmarkResult();
+        result.name = "trace_path";
+        result.unit = "ray";
+        result.sphereCount = sphereCount;
+        result.width = 64;
+        result.height = 64;
+        if (Measure(options, result, [&]()
+        {
+            uint64_t startRayCount = ThreadRayCount();
+            Random random;
+            float sum = 0.0f;
+            for (const Ray& ray : cameraRays)
+            {
+                sum += TracePath(ray, scene, RenderSettings(), ray.origin, random).x;
+            }
+            sink = sum;
+            return ThreadRayCount() - startRayCount;
+        }))
+        {
+            results.push_back(result);
+        }
+
+        const int kResolutions[] = { 256, 512 };
+        for (int resolution : kResolutions)
+        {
+            Framebuffer framebuffer(resolution, resolution);
+            RenderSettings settings;
+            settings.threadCount = options.threadCount;
+
+            result = BenchmarkResult();
+            result.name = "render";
+            result.unit = "ray";
+            result.sphereCount = sphereCount;
+            result.width = resolution;
+            result.height = resolution;
+            if (Measure(options, result, [&]()
+            {
+                return Render(scene, framebuffer, settings);
+            }))
+            {
+                results.push_back(result);
+            }
+
+            RenderSettings wavefrontSettings = settings;
+            wavefrontSettings.useWavefront = true;
+
+            result.name = "render_wavefront";
+            result.nsPerOp.clear();
+            if (Measure(options, result, [&]()
+            {
+                return Render(scene, framebuffer, wavefrontSettings);
+            }))
+            {
+                results.push_back(result);
+            }
+        }
+    }
+
+    // Next-event estimation: per-hit cost should barely move with light count
+    const int kLightCounts[] = { 4, 64, 1024 };
+    for (int lightCount : kLightCounts)
+    {
+        Scene scene;
+        BuildDefaultScene(scene, 40, lightCount);
+        Framebuffer framebuffer(256, 256);
+        RenderSettings settings;
+        settings.threadCount = options.threadCount;
+
+        result = BenchmarkResult();
+        result.name = "render_lights_" + std::to_string(lightCount);
+        result.unit = "ray";
+        result.sphereCount = 40;
+        result.width = framebuffer.width;
+        result.height = framebuffer.height;
+        if (Measure(options, result, [&]()
+        {
+            return Render(scene, framebuffer, settings);
+        }))
+        {
+            results.push_back(result);
+        }
+    }
+
+    // Triangle meshes: a torus in the default scene, coarse and fine
+    const int kTorusSegments[] = { 32, 256 };
+    for (int rings : kTorusSegments)
+    {
+        Scene scene;
+        BuildDefaultScene(scene, 40);
+        AppendTorus(scene.vertices, scene.vertexNormals, scene.triangles, Vector3{ 0.0f, 1.0f, 5.0f }, 2.0f, 0.6f, rings, rings / 2);
+        scene.triangleMaterials.assign(scene.triangles.size(), 7);
+        scene.triangleBvh.Build(scene.vertices, scene.vertexNormals, scene.triangles, options.threadCount);
+        std::vector<Ray> cameraRays = CameraRays(64, 64);
+        int triangleCount = static_cast<int>(scene.triangles.size());
+
+        // Wide kernel over the whole flat list; one operation is one ray
+        if (triangleCount <= 1024)
+        {
+            result = BenchmarkResult();
+            result.name = "intersect_triangles_wide";
+            result.unit = "ray";
+            result.sphereCount = 40;
+            result.triangleCount = triangleCount;
+            const TriangleSoA& triangles = scene.triangleBvh.leafTriangles;
+            if (Measure(options, result, [&]()
+            {
+                float sum = 0.0f;
+                for (const Ray& ray : cameraRays)
+                {
+                    float tMax = FLT_MAX;
+                    float u;
+                    float v;
+                    sum += static_cast<float>(IntersectNearestTriangles(triangles, 0, triangles.count, ray, 0.0f, tMax, u, v));
+                }
+                sink = sum;
+                return static_cast<uint64_t>(cameraRays.size());
+            }))
+            {
+                results.push_back(result);
+            }
+        }
+
+        result = BenchmarkResult();
+        result.name = "trace_mesh";
+        result.unit = "ray";
+        result.sphereCount = 40;
+        result.triangleCount = triangleCount;
+        if (Measure(options, result, [&]()
+        {
+            uint64_t hits = 0;
+            for (const Ray& ray : cameraRays)
+            {
+                HitRecord hit;
+                hits += TraceRayClosest(ray, scene, hit) ? 1 : 0;
+            }
+            sink = static_cast<float>(hits);
+            return static_cast<uint64_t>(cameraRays.size());
+        }))
+        {
+            results.push_back(result);
+        }
+
+        Framebuffer framebuffer(256, 256);
+        RenderSettings settings;
+        settings.threadCount = options.threadCount;
+
+        result = BenchmarkResult();
+        result.name = "render_mesh";
+        result.unit = "ray";
+        result.sphereCount = 40;
+        result.triangleCount = triangleCount;
+        result.width = framebuffer.width;
+        result.height = framebuffer.height;
+        if (Measure(options, result, [&]()
+        {
+            return Render(scene, framebuffer, settings);
+        }))
+        {
+            results.push_back(result);
+        }
+    }
+
+    // Denoiser on a two-sample image with features, per output pixel
+    {
+        Scene scene;
+        BuildDefaultScene(scene, 40, 64);
+        Framebuffer framebuffer(256, 256);
+        AccumulationBuffer accumulation(framebuffer.width, framebuffer.height);
+        accumulation.EnableFeatures();
+        RenderSettings settings;
+        settings.threadCount = options.threadCount;
+        settings.sampleBounces = true;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            RenderPass(scene, accumulation, framebuffer, settings);
+        }
+
+        DenoiseSettings denoiseSettings;
+        denoiseSettings.threadCount = options.threadCount;
+
+        result = BenchmarkResult();
+        result.name = "denoise";
+        result.unit = "pixel";
+        result.sphereCount = 40;
+        result.width = framebuffer.width;
+        result.height = framebuffer.height;
+        if (Measure(options, result, [&]()
+        {
+            Denoise(accumulation, framebuffer, denoiseSettings);
+            return static_cast<uint64_t>(framebuffer.width) * framebuffer.height;
+        }))
+        {
+            results.push_back(result);
+        }
+    }
+
+    // One frame of a slowly moving camera per output pixel, retraced from
+    // scratch and with the previous frame reprojected
+    for (int temporal = 0; temporal < 2; ++temporal)
+    {
+        Scene scene;
+        BuildDefaultScene(scene, 40, 64);
+        Framebuffer framebuffer(256, 256);
+        AccumulationBuffer accumulation(framebuffer.width, framebuffer.height);
+        accumulation.EnableFeatures();
+        RenderSettings settings;
+        settings.threadCount = options.threadCount;
+        TemporalSettings temporalSettings;
+        temporalSettings.threadCount = options.threadCount;
+        RenderPass(scene, accumulation, framebuffer, settings);
+
+        result = BenchmarkResult();
+        result.name = temporal ? "frame_temporal" : "frame_moving";
+        result.unit = "pixel";
+        result.sphereCount = 40;
+        result.width = framebuffer.width;
+        result.height = framebuffer.height;
+        if (Measure(options, result, [&]()
+        {
+            Vector3 previousCamera = settings.cameraPosition;
+            settings.cameraPosition = settings.cameraPosition + Vector3(0.01f, 0.0f, 0.0f);
+            if (temporal)
+            {
+                Reproject(accumulation, framebuffer, previousCamera, settings.cameraPosition, temporalSettings);
+            }
+            else
+            {
+                accumulation.Reset();
+            }
+            RenderPass(scene, accumulation, framebuffer, settings);
+            return static_cast<uint64_t>(framebuffer.width) * framebuffer.height;
+        }))
+        {
+            results.push_back(result);
+        }
+    }
+
+    // Scale sweep over point clouds. Each scene is built once, so the build
+    // case has a single sample.
+    const char* kMortonCases[][2] = {
+        { "sweep_build_morton", "sweep_render_morton" },
+        { "sweep_build_treelets", "sweep_render_treelets" },
+    };
+    bool sweepSelected = Selected(options, "sweep_build") || Selected(options, "sweep_render") || Selected(options, "sweep_refit");
+    for (const auto& names : kMortonCases)
+    {
+        sweepSelected = sweepSelected || Selected(options, names[0]) || Selected(options, names[1]);
+    }
+    for (int64_t sphereCount = 10; sphereCount <= options.maxSpheres && sweepSelected; sphereCount *= 10)
+    {
+        Scene scene;
+        auto start = std::chrono::steady_clock::now();
+        BuildPointCloudScene(scene, static_cast<int>(sphereCount), 0, options.threadCount);
+        double buildNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        result = BenchmarkResult();
+        result.name = "sweep_build";
+        result.unit = "sphere";
+        result.sphereCount = static_cast<int>(scene.spheres.size());
+        result.operations = scene.spheres.size();
+        result.memoryBytes = MeasureSceneMemory(scene).Total();
+        result.nsPerOp.push_back(buildNs / static_cast<double>(result.operations));
+        if (Selected(options, result.name))
+        {
+            PrintResult(result);
+            results.push_back(result);
+        }
+
+        Framebuffer framebuffer(256, 256);
+        RenderSettings settings;
+        settings.threadCount = options.threadCount;
+
+        result.name = "sweep_render";
+        result.unit = "ray";
+        result.width = framebuffer.width;
+        result.height = framebuffer.height;
+        result.nsPerOp.clear();
+        if (Measure(options, result, [&]()
+        {
+            return Render(scene, framebuffer, settings);
+        }))
+        {
+            results.push_back(result);
+        }
+
+        // One animation step, then refits of the moved spheres
+        SphereAnimation animation;
+        if (Selected(options, "sweep_refit"))
+        {
+            animation.Capture(scene);
+            animation.Apply(scene, 1.0f / 30.0f, options.threadCount);
+        }
+        result.name = "sweep_refit";
+        result.unit = "sphere";
+        result.width = 0;
+        result.height = 0;
+        result.nsPerOp.clear();
+        if (Measure(options, result, [&]()
+        {
+            scene.bvh.Refit(options.threadCount);
+            return static_cast<uint64_t>(scene.spheres.size());
+        }))
+        {
+            results.push_back(result);
+        }
+
+        // Morton rebuilds of the spheres at rest, traced like sweep_render
+        if (Selected(options, "sweep_refit"))
+        {
+            animation.Apply(scene, 0.0f, options.threadCount);
+        }
+        scene.bvh.builder = BvhBuilder::Morton;
+        for (int treelets = 0; treelets < 2; ++treelets)
+        {
+            const char* const* names = kMortonCases[treelets];
+            if (!Selected(options, names[0]) && !Selected(options, names[1]))
+            {
+                continue;
+            }
+
+            scene.bvh.optimizeTreelets = treelets != 0;
+            result.name = names[0];
+            result.unit = "sphere";
+            result.width = 0;
+            result.height = 0;
+            result.nsPerOp.clear();
+            if (Measure(options, result, [&]()
+            {
+                scene.bvh.Build(scene.spheres, options.threadCount);
+                return static_cast<uint64_t>(scene.spheres.size());
+            }))
+            {
+                results.push_back(result);
+            }
+            else
+            {
+                scene.bvh.Build(scene.spheres, options.threadCount);
+            }
+
+            result.name = names[1];
+            result.unit = "ray";
+            result.width = framebuffer.width;
+            result.height = framebuffer.height;
+            result.nsPerOp.clear();
+            if (Measure(options, result, [&]()
+            {
+                return Render(scene, framebuffer, settings);
+            }))
+            {
+                results.push_back(result);
+            }
+        }
+    }
+
+    FILE* file = options.outputPath ? fopen(options.outputPath, "w") : stdout;
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", options.outputPath);
+        return 1;
+    }
+    WriteJson(file, options, results);
+    if (file != stdout)
+    {
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Buffer.h
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Contiguous array that either owns its elements or views memory owned by
+// someone else, such as a mapped scene cache. Readers cannot tell the two
+// apart. Element writes go wherever the data lives; anything that changes
+// the size first copies a view into owned storage. The member names follow
+// std::vector so building code reads the same as before.
+template< typename T >
+class Buffer
+{
+public:
+    Buffer() = default;
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    // Views count elements at data, which must stay valid while viewed
+    void View(T* data, size_t count)
+    {
+        storage.clear();
+        storage.shrink_to_fit();
+        first = data;
+        length = count;
+    }
+
+    bool IsView() const
+    {
+        return first != storage.data();
+    }
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    T* data() { return first; }
+    const T* data() const { return first; }
+    T* begin() { return first; }
+    const T* begin() const { return first; }
+    T* end() { return first + length; }
+    const T* end() const { return first + length; }
+    T& operator[](size_t index) { return first[index]; }
+    const T& operator[](size_t index) const { return first[index]; }
+    T& back() { return first[length - 1]; }
+    const T& back() const { return first[length - 1]; }
+
+    void clear()
+    {
+        storage.clear();
+        Sync();
+    }
+
+    void reserve(size_t count)
+    {
+        Own();
+        storage.reserve(count);
+        Sync();
+    }
+
+    void resize(size_t count)
+    {
+        Own();
+        storage.resize(count);
+        Sync();
+    }
+
+    void resize(size_t count, const T& value)
+    {
+        Own();
+        storage.resize(count, value);
+        Sync();
+    }
+
+    void assign(size_t count, const T& value)
+    {
+        storage.assign(count, value);
+        Sync();
+    }
+
+    void push_back(const T& value)
+    {
+        Own();
+        storage.push_back(value);
+        Sync();
+    }
+
+    template< typename... Args >
+    void emplace_back(Args&&... args)
+    {
+        Own();
+        storage.emplace_back(std::forward<Args>(args)...);
+        Sync();
+    }
+
+    void shrink_to_fit()
+    {
+        Own();
+        storage.shrink_to_fit();
+        Sync();
+    }
+
+private:
+    void Own()
+    {
+        if (IsView())
+        {
+            storage.assign(first, first + length);
+        }
+    }
+
+    void Sync()
+    {
+        first = storage.data();
+        length = storage.size();
+    }
+
+    std::vector<T> storage;
+    T*             first = nullptr;
+    size_t         length = 0;
+};
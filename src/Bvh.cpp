@@ -0,0 +1,700 @@
+// Bvh.cpp
+
+#include "Bvh.h"
+#include "BvhBuilder.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace Simd;
+
+namespace
+{
+
+// A level leaves at most kWidth - 1 entries behind and the collapsed
+// hierarchy is well under 64 levels deep
+const int kStackSize = (WideBvhNode::kWidth - 1) * 64 + 1;
+
+const uint32_t kNoNode = 0xffffffffu;
+
+// Largest sphere count a leaf child can record
+const uint32_t kMaxLeafChild = 255;
+
+// A binary node is only opened into its parent's slots if it spans at least
+// this share of the parent along some axis. Smaller ones keep a wide node
+// of their own, whose finer grid keeps their children's boxes tight.
+const float kMinOpenExtent = 1.0f / 32.0f;
+
+// Nodes of one tree level refit per thread pool task
+const uint32_t kRefitChunkSize = 1 << 10;
+
+class SpherePrimitives
+{
+public:
+    Aabb Bounds(uint32_t index) const
+    {
+        return SphereBounds(spheres[index]);
+    }
+
+    const Buffer<Sphere>& spheres;
+};
+
+// A child while collapsing: a binary interior node, or a range of the
+// binary index array. Ranges too large for a leaf child become nodes of
+// their own and are split evenly.
+class WideChild
+{
+public:
+    bool IsLeaf() const
+    {
+        return binaryNode == kNoNode && count <= kMaxLeafChild;
+    }
+
+    Aabb     bounds;
+    uint32_t binaryNode;
+    uint32_t first;
+    uint32_t count;
+};
+
+class Collapser
+{
+public:
+    const Buffer<BvhNode>&  binaryNodes;
+    const Buffer<uint32_t>& binaryIndices;
+    const Buffer<Sphere>&   spheres;
+    Buffer<WideBvhNode>&    nodes;
+    Buffer<uint32_t>&       indices;
+    uint32_t                leafCount;
+    uint32_t                maxDepth;
+};
+
+WideChild BinaryChild(const Collapser& collapser, uint32_t nodeIndex)
+{
+    const BvhNode& node = collapser.binaryNodes[nodeIndex];
+    WideChild child;
+    child.bounds = node.bounds;
+    child.binaryNode = node.IsLeaf() ? kNoNode : nodeIndex;
+    child.first = node.leftFirst;
+    child.count = node.count;
+    return child;
+}
+
+// Children of a wide node: the binary node's two children, opening the
+// interior child with the largest surface area until there are kWidth
+uint32_t GatherChildren(const Collapser& collapser, const WideChild& parent, WideChild* children)
+{
+    const uint32_t kWidth = WideBvhNode::kWidth;
+    if (parent.IsLeaf())
+    {
+        children[0] = parent; // A root that is a single leaf
+        return 1;
+    }
+
+    if (parent.binaryNode == kNoNode)
+    {
+        uint32_t chunkCount = std::min(kWidth, (parent.count + kMaxLeafChild - 1) / kMaxLeafChild);
+        for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            WideChild& child = children[chunk];
+            child.binaryNode = kNoNode;
+            child.first = parent.first + static_cast<uint32_t>(static_cast<uint64_t>(parent.count) * chunk / chunkCount);
+            child.count = parent.first + static_cast<uint32_t>(static_cast<uint64_t>(parent.count) * (chunk + 1) / chunkCount) - child.first;
+            child.bounds = Aabb();
+            for (uint32_t i = child.first; i < child.first + child.count; ++i)
+            {
+                child.bounds.Grow(SphereBounds(collapser.spheres[collapser.binaryIndices[i]]));
+            }
+        }
+        return chunkCount;
+    }
+
+    Vector3 parentExtent = parent.bounds.max - parent.bounds.min;
+    auto worthOpening = [&](const WideChild& child)
+    {
+        Vector3 extent = child.bounds.max - child.bounds.min;
+        return child.binaryNode != kNoNode && (extent.x >= parentExtent.x * kMinOpenExtent ||
+            extent.y >= parentExtent.y * kMinOpenExtent || extent.z >= parentExtent.z * kMinOpenExtent);
+    };
+
+    const BvhNode& node = collapser.binaryNodes[parent.binaryNode];
+    children[0] = BinaryChild(collapser, node.leftFirst);
+    children[1] = BinaryChild(collapser, node.leftFirst + 1);
+    uint32_t childCount = 2;
+    while (childCount < kWidth)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; ++i)
+        {
+            float area = children[i].bounds.SurfaceArea();
+            if (worthOpening(children[i]) && area > largestArea)
+            {
+                largest = static_cast<int>(i);
+                largestArea = area;
+            }
+        }
+        if (largest < 0)
+        {
+            break;
+        }
+
+        uint32_t opened = collapser.binaryNodes[children[largest].binaryNode].leftFirst;
+        children[largest] = BinaryChild(collapser, opened);
+        children[childCount++] = BinaryChild(collapser, opened + 1);
+    }
+    return childCount;
+}
+
+// Sets the node's grid to cover its children's exact boxes and rounds each
+// box outward onto it
+void Quantize(const Aabb* childBounds, uint32_t childCount, WideBvhNode& node)
+{
+    Aabb parent;
+    for (uint32_t slot = 0; slot < childCount; ++slot)
+    {
+        parent.Grow(childBounds[slot]);
+    }
+    node.origin = parent.min;
+
+    uint8_t* lower[3] = { node.lowerX, node.lowerY, node.lowerZ };
+    uint8_t* upper[3] = { node.upperX, node.upperY, node.upperZ };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float origin = BvhBuild::Axis(parent.min, axis);
+        float extent = BvhBuild::Axis(parent.max, axis) - origin;
+        int exponent = extent > 0.0f ? std::max(-126, static_cast<int>(ceilf(log2f(extent / 255.0f)))) : -126;
+        while (exponent < 127 && origin + 255.0f * GridStep(static_cast<int8_t>(exponent)) < origin + extent)
+        {
+            ++exponent;
+        }
+        node.exponents[axis] = static_cast<int8_t>(exponent);
+
+        float step = GridStep(node.exponents[axis]);
+        for (uint32_t slot = 0; slot < childCount; ++slot)
+        {
+            float childMin = BvhBuild::Axis(childBounds[slot].min, axis);
+            float childMax = BvhBuild::Axis(childBounds[slot].max, axis);
+            int quantizedMin = std::min(std::max(static_cast<int>(floorf((childMin - origin) / step)), 0), 255);
+            while (quantizedMin > 0 && origin + static_cast<float>(quantizedMin) * step > childMin)
+            {
+                --quantizedMin;
+            }
+            int quantizedMax = std::min(std::max(static_cast<int>(ceilf((childMax - origin) / step)), 0), 255);
+            while (quantizedMax < 255 && origin + static_cast<float>(quantizedMax) * step < childMax)
+            {
+                ++quantizedMax;
+            }
+            lower[axis][slot] = static_cast<uint8_t>(quantizedMin);
+            upper[axis][slot] = static_cast<uint8_t>(quantizedMax);
+        }
+    }
+}
+
+// Writes the wide node for parent at wideIndex, then its interior children
+// depth first. Interior children are allocated together; leaf children
+// append their spheres to the new index array in slot order.
+void EmitNode(Collapser& collapser, uint32_t wideIndex, const WideChild& parent, uint32_t depth)
+{
+    collapser.maxDepth = std::max(collapser.maxDepth, depth + 1);
+
+    WideChild children[WideBvhNode::kWidth];
+    uint32_t childCount = GatherChildren(collapser, parent, children);
+
+    Aabb childBounds[WideBvhNode::kWidth];
+    for (uint32_t slot = 0; slot < childCount; ++slot)
+    {
+        childBounds[slot] = children[slot].bounds;
+    }
+
+    WideBvhNode node = {};
+    Quantize(childBounds, childCount, node);
+    node.childCount = static_cast<uint8_t>(childCount);
+    node.childBase = static_cast<uint32_t>(collapser.nodes.size());
+    node.primitiveBase = static_cast<uint32_t>(collapser.indices.size());
+    uint32_t interiorCount = 0;
+    for (uint32_t slot = 0; slot < childCount; ++slot)
+    {
+        const WideChild& child = children[slot];
+        if (!child.IsLeaf())
+        {
+            ++interiorCount;
+            continue;
+        }
+
+        node.childPrimitives[slot] = static_cast<uint8_t>(child.count);
+        for (uint32_t i = child.first; i < child.first + child.count; ++i)
+        {
+            collapser.indices.push_back(collapser.binaryIndices[i]);
+        }
+        ++collapser.leafCount;
+    }
+    collapser.nodes.resize(collapser.nodes.size() + interiorCount);
+    collapser.nodes[wideIndex] = node;
+
+    uint32_t nextNode = node.childBase;
+    for (uint32_t slot = 0; slot < childCount; ++slot)
+    {
+        if (!children[slot].IsLeaf())
+        {
+            EmitNode(collapser, nextNode++, children[slot], depth + 1);
+        }
+    }
+}
+
+// Recomputes the exact box of every node from the spheres, deepest level
+// first with each level's nodes in parallel, and requantizes their
+// children. Returns the tree's SAH cost as BvhStats defines it.
+float RefitNodes(Buffer<WideBvhNode>& nodes, const Buffer<uint32_t>& indices, const Buffer<Sphere>& spheres, int threadCount)
+{
+    const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+    if (nodeCount == 0)
+    {
+        return 0.0f;
+    }
+
+    // Children always follow their parent, so one pass in index order finds
+    // every depth; the nodes are then grouped by level
+    std::vector<uint32_t> depths(nodeCount, 0);
+    uint32_t levelCount = 1;
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        const WideBvhNode& node = nodes[i];
+        uint32_t targets[WideBvhNode::kWidth];
+        node.ChildTargets(targets);
+        for (uint32_t slot = 0; slot < node.childCount; ++slot)
+        {
+            if (!node.IsLeafChild(slot))
+            {
+                depths[targets[slot]] = depths[i] + 1;
+                levelCount = std::max(levelCount, depths[i] + 2);
+            }
+        }
+    }
+    std::vector<uint32_t> levelStart(levelCount + 1, 0);
+    for (uint32_t depth : depths)
+    {
+        ++levelStart[depth + 1];
+    }
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        levelStart[level + 1] += levelStart[level];
+    }
+    std::vector<uint32_t> levelNodes(nodeCount);
+    std::vector<uint32_t> levelFill(levelStart.begin(), levelStart.end() - 1);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        levelNodes[levelFill[depths[i]]++] = i;
+    }
+
+    std::vector<Aabb> nodeBounds(nodeCount);
+    std::vector<float> nodeCosts(nodeCount);
+    std::vector<uint32_t> nodeSizes(nodeCount);
+    ThreadPool& pool = SharedThreadPool(threadCount);
+    for (uint32_t level = levelCount; level-- > 0;)
+    {
+        uint32_t first = levelStart[level];
+        uint32_t count = levelStart[level + 1] - first;
+        uint32_t chunkCount = (count + kRefitChunkSize - 1) / kRefitChunkSize;
+        pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+        {
+            uint32_t last = first + std::min((chunk + 1) * kRefitChunkSize, count);
+            for (uint32_t i = first + chunk * kRefitChunkSize; i < last; ++i)
+            {
+                uint32_t nodeIndex = levelNodes[i];
+                WideBvhNode& node = nodes[nodeIndex];
+                uint32_t targets[WideBvhNode::kWidth];
+                node.ChildTargets(targets);
+
+                Aabb childBounds[WideBvhNode::kWidth];
+                Aabb bounds;
+                for (uint32_t slot = 0; slot < node.childCount; ++slot)
+                {
+                    if (node.IsLeafChild(slot))
+                    {
+                        for (uint32_t k = targets[slot]; k < targets[slot] + node.childPrimitives[slot]; ++k)
+                        {
+                            childBounds[slot].Grow(SphereBounds(spheres[indices[k]]));
+                        }
+                    }
+                    else
+                    {
+                        childBounds[slot] = nodeBounds[targets[slot]];
+                    }
+                    bounds.Grow(childBounds[slot]);
+                }
+                Quantize(childBounds, node.childCount, node);
+                nodeBounds[nodeIndex] = bounds;
+
+                float area = bounds.SurfaceArea();
+                float cost = BvhBuild::kTraversalCost;
+                uint32_t size = 0;
+                for (uint32_t slot = 0; slot < node.childCount; ++slot)
+                {
+                    size += node.IsLeafChild(slot) ? node.childPrimitives[slot] : nodeSizes[targets[slot]];
+                    float childCost = node.IsLeafChild(slot) ? BvhBuild::LeafCost(node.childPrimitives[slot]) : nodeCosts[targets[slot]];
+                    cost += (area > 0.0f ? childBounds[slot].SurfaceArea() / area : 1.0f) * childCost;
+                }
+                nodeCosts[nodeIndex] = cost;
+                nodeSizes[nodeIndex] = size;
+            }
+        });
+    }
+
+    // Summed in index order so the cost does not depend on the thread count
+    double cost = 0.0;
+    double size = 0.0;
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        cost += static_cast<double>(nodeCosts[i]) * nodeSizes[i];
+        size += nodeSizes[i];
+    }
+    return size > 0.0 ? static_cast<float>(cost / size) : 0.0f;
+}
+
+// Entry distances of the children whose boxes overlap [tMin, tMax] along
+// the ray; returns their slots as a bit mask
+uint32_t IntersectChildren(const WideBvhNode& node, const Vector3& origin, const Vector3& inverseDirection, float tMin, float tMax, float* entry)
+{
+    uint32_t mask = 0;
+#if defined(SOFTRT_SIMD)
+    // World plane = quantized * step + node origin; the same slab test as
+    // IntersectAabb with every child in a lane
+    const Lanes stepX = Set1(GridStep(node.exponents[0]));
+    const Lanes stepY = Set1(GridStep(node.exponents[1]));
+    const Lanes stepZ = Set1(GridStep(node.exponents[2]));
+    const Lanes offsetX = Set1(node.origin.x - origin.x);
+    const Lanes offsetY = Set1(node.origin.y - origin.y);
+    const Lanes offsetZ = Set1(node.origin.z - origin.z);
+    const Lanes inverseX = Set1(inverseDirection.x);
+    const Lanes inverseY = Set1(inverseDirection.y);
+    const Lanes inverseZ = Set1(inverseDirection.z);
+    const Lanes minT = Set1(tMin);
+    const Lanes maxT = Set1(tMax);
+    for (uint32_t base = 0; base < node.childCount; base += kLanes)
+    {
+        Lanes tx0 = Mul(Add(Mul(LoadBytes(&node.lowerX[base]), stepX), offsetX), inverseX);
+        Lanes tx1 = Mul(Add(Mul(LoadBytes(&node.upperX[base]), stepX), offsetX), inverseX);
+        Lanes ty0 = Mul(Add(Mul(LoadBytes(&node.lowerY[base]), stepY), offsetY), inverseY);
+        Lanes ty1 = Mul(Add(Mul(LoadBytes(&node.upperY[base]), stepY), offsetY), inverseY);
+        Lanes tz0 = Mul(Add(Mul(LoadBytes(&node.lowerZ[base]), stepZ), offsetZ), inverseZ);
+        Lanes tz1 = Mul(Add(Mul(LoadBytes(&node.upperZ[base]), stepZ), offsetZ), inverseZ);
+        Lanes tEntry = MaxLanes(MaxLanes(MinLanes(tx0, tx1), MinLanes(ty0, ty1)), MaxLanes(MinLanes(tz0, tz1), minT));
+        Lanes tExit = MinLanes(MinLanes(MaxLanes(tx0, tx1), MaxLanes(ty0, ty1)), MinLanes(MaxLanes(tz0, tz1), maxT));
+        Store(entry + base, tEntry);
+        mask |= static_cast<uint32_t>(MoveMask(CmpLe(tEntry, tExit))) << base;
+    }
+    mask &= (1u << node.childCount) - 1;
+#else
+    for (uint32_t slot = 0; slot < node.childCount; ++slot)
+    {
+        entry[slot] = IntersectAabb(origin, inverseDirection, WideChildBounds(node, slot), tMin, tMax);
+        mask |= entry[slot] != FLT_MAX ? 1u << slot : 0u;
+    }
+#endif
+    return mask;
+}
+
+// Slots in mask ordered by ascending entry distance; returns their count
+uint32_t SortByEntry(uint32_t mask, const float* entry, uint32_t* order)
+{
+    uint32_t count = 0;
+    for (uint32_t slot = 0; mask != 0; ++slot, mask >>= 1)
+    {
+        if ((mask & 1) == 0)
+        {
+            continue;
+        }
+        uint32_t i = count++;
+        for (; i > 0 && entry[order[i - 1]] > entry[slot]; --i)
+        {
+            order[i] = order[i - 1];
+        }
+        order[i] = slot;
+    }
+    return count;
+}
+
+} // namespace
+
+uint32_t IntersectChildrenPacket(const WideBvhNode& node, const Vector3& origin, const float* inverseX, const float* inverseY, const float* inverseZ, uint32_t rayCount, float tMin, const float* tMax, float* nearestEntry)
+{
+    uint32_t mask = 0;
+    std::fill(nearestEntry, nearestEntry + WideBvhNode::kWidth, FLT_MAX);
+#if defined(SOFTRT_SIMD)
+    // Decode the child planes relative to the shared origin once; each ray
+    // then only scales them by its inverse direction
+    const Lanes stepX = Set1(GridStep(node.exponents[0]));
+    const Lanes stepY = Set1(GridStep(node.exponents[1]));
+    const Lanes stepZ = Set1(GridStep(node.exponents[2]));
+    const Lanes offsetX = Set1(node.origin.x - origin.x);
+    const Lanes offsetY = Set1(node.origin.y - origin.y);
+    const Lanes offsetZ = Set1(node.origin.z - origin.z);
+    const Lanes minT = Set1(tMin);
+    for (uint32_t base = 0; base < node.childCount; base += kLanes)
+    {
+        Lanes x0 = Add(Mul(LoadBytes(&node.lowerX[base]), stepX), offsetX);
+        Lanes x1 = Add(Mul(LoadBytes(&node.upperX[base]), stepX), offsetX);
+        Lanes y0 = Add(Mul(LoadBytes(&node.lowerY[base]), stepY), offsetY);
+        Lanes y1 = Add(Mul(LoadBytes(&node.upperY[base]), stepY), offsetY);
+        Lanes z0 = Add(Mul(LoadBytes(&node.lowerZ[base]), stepZ), offsetZ);
+        Lanes z1 = Add(Mul(LoadBytes(&node.upperZ[base]), stepZ), offsetZ);
+        Lanes nearest = Set1(FLT_MAX);
+        for (uint32_t ray = 0; ray < rayCount; ++ray)
+        {
+            const Lanes invX = Set1(inverseX[ray]);
+            const Lanes invY = Set1(inverseY[ray]);
+            const Lanes invZ = Set1(inverseZ[ray]);
+            Lanes tx0 = Mul(x0, invX);
+            Lanes tx1 = Mul(x1, invX);
+            Lanes ty0 = Mul(y0, invY);
+            Lanes ty1 = Mul(y1, invY);
+            Lanes tz0 = Mul(z0, invZ);
+            Lanes tz1 = Mul(z1, invZ);
+            Lanes tEntry = MaxLanes(MaxLanes(MinLanes(tx0, tx1), MinLanes(ty0, ty1)), MaxLanes(MinLanes(tz0, tz1), minT));
+            Lanes tExit = MinLanes(MinLanes(MaxLanes(tx0, tx1), MaxLanes(ty0, ty1)), MinLanes(MaxLanes(tz0, tz1), Set1(tMax[ray])));
+            nearest = Select(CmpLe(tEntry, tExit), MinLanes(nearest, tEntry), nearest);
+        }
+        Store(nearestEntry + base, nearest);
+        mask |= static_cast<uint32_t>(MoveMask(CmpGt(Set1(FLT_MAX), nearest))) << base;
+    }
+    mask &= (1u << node.childCount) - 1;
+#else
+    for (uint32_t slot = 0; slot < node.childCount; ++slot)
+    {
+        Aabb bounds = WideChildBounds(node, slot);
+        for (uint32_t ray = 0; ray < rayCount; ++ray)
+        {
+            Vector3 inverseDirection{ inverseX[ray], inverseY[ray], inverseZ[ray] };
+            nearestEntry[slot] = Min(nearestEntry[slot], IntersectAabb(origin, inverseDirection, bounds, tMin, tMax[ray]));
+        }
+        mask |= nearestEntry[slot] != FLT_MAX ? 1u << slot : 0u;
+    }
+#endif
+    return mask;
+}
+
+void Bvh::Build(const Buffer<Sphere>& inSpheres, int threadCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    spheres = &inSpheres;
+    stats = BvhStats();
+    stats.width = WideBvhNode::kWidth;
+    nodes.clear();
+    primitiveIndices.clear();
+
+    Buffer<BvhNode> binaryNodes;
+    Buffer<uint32_t> binaryIndices;
+    BvhStats binaryStats;
+    if (builder == BvhBuilder::Morton)
+    {
+        BuildMortonNodes(SpherePrimitives{ inSpheres }, static_cast<uint32_t>(inSpheres.size()), threadCount, optimizeTreelets, binaryNodes, binaryIndices, binaryStats);
+    }
+    else
+    {
+        BuildBvhNodes(SpherePrimitives{ inSpheres }, static_cast<uint32_t>(inSpheres.size()), threadCount, binaryNodes, binaryIndices, binaryStats);
+    }
+    stats.builder = builder;
+    stats.treelets = builder == BvhBuilder::Morton && optimizeTreelets;
+    stats.phases = binaryStats.phases;
+
+    auto phaseStart = std::chrono::steady_clock::now();
+    if (!binaryNodes.empty())
+    {
+        Collapser collapser{ binaryNodes, binaryIndices, inSpheres, nodes, primitiveIndices, 0, 0 };
+        nodes.reserve(binaryNodes.size() / 4 + 1);
+        primitiveIndices.reserve(binaryIndices.size());
+        nodes.resize(1);
+        EmitNode(collapser, 0, BinaryChild(collapser, 0), 0);
+        stats.leafCount = collapser.leafCount;
+        stats.maxDepth = collapser.maxDepth;
+    }
+    stats.sahCost = RefitNodes(nodes, primitiveIndices, inSpheres, threadCount);
+    builtSahCost = stats.sahCost;
+    stats.phases.collapseMs = BvhBuild::MillisecondsSince(phaseStart);
+
+    phaseStart = std::chrono::steady_clock::now();
+    leafSpheres.Build(inSpheres, &primitiveIndices, threadCount);
+    stats.phases.leavesMs = BvhBuild::MillisecondsSince(phaseStart);
+
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.memoryBytes = MemoryBytes();
+    stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Bvh::Refit(int threadCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    stats.sahCost = RefitNodes(nodes, primitiveIndices, *spheres, threadCount);
+    stats.refitSahCost = stats.sahCost;
+    leafSpheres.Build(*spheres, &primitiveIndices, threadCount);
+
+    stats.refitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Bvh::Update(int threadCount, float rebuildRatio)
+{
+    Refit(threadCount);
+    if (stats.sahCost <= builtSahCost * rebuildRatio)
+    {
+        return false;
+    }
+
+    BvhStats refitStats = stats;
+    Build(*spheres, threadCount);
+    stats.refitSahCost = refitStats.refitSahCost;
+    stats.refitMs = refitStats.refitMs;
+    return true;
+}
+
+void Bvh::Clear()
+{
+    nodes.clear();
+    primitiveIndices.clear();
+    leafSpheres.count = 0;
+    leafSpheres.centerX.clear();
+    leafSpheres.centerY.clear();
+    leafSpheres.centerZ.clear();
+    leafSpheres.radiusSquared.clear();
+    spheres = nullptr;
+    stats = BvhStats();
+    stats.width = WideBvhNode::kWidth;
+    builtSahCost = 0.0f;
+}
+
+size_t Bvh::MemoryBytes() const
+{
+    return nodes.size() * sizeof(WideBvhNode) + primitiveIndices.size() * sizeof(uint32_t) + leafSpheres.MemoryBytes();
+}
+
+bool Bvh::ClosestHit(const Ray& ray, float tMin, float tMax, HitRecord& hit) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+    int nearest = -1;
+
+    // Entries carry the node's ray entry distance so nodes beyond the current
+    // nearest hit are skipped without retesting their bounds
+    uint32_t stack[kStackSize];
+    float stackEntry[kStackSize];
+    uint8_t stackCount[kStackSize]; // Leaf size, or 0 for a node
+    int stackSize = 0;
+    stack[stackSize] = 0;
+    stackEntry[stackSize] = tMin;
+    stackCount[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        --stackSize;
+        if (stackEntry[stackSize] > tMax)
+        {
+            continue;
+        }
+
+        if (stackCount[stackSize] > 0)
+        {
+            int index = IntersectNearest(leafSpheres, stack[stackSize], stackCount[stackSize], ray, tMin, tMax);
+            nearest = index >= 0 ? index : nearest;
+            continue;
+        }
+
+        const WideBvhNode& node = nodes[stack[stackSize]];
+        float entry[WideBvhNode::kWidth];
+        uint32_t mask = IntersectChildren(node, ray.origin, inverseDirection, tMin, tMax, entry);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // Push far first so the nearest child pops next
+        uint32_t order[WideBvhNode::kWidth];
+        uint32_t targets[WideBvhNode::kWidth];
+        uint32_t hitCount = SortByEntry(mask, entry, order);
+        node.ChildTargets(targets);
+        while (hitCount > 0)
+        {
+            uint32_t slot = order[--hitCount];
+            stack[stackSize] = targets[slot];
+            stackEntry[stackSize] = entry[slot];
+            stackCount[stackSize++] = node.childPrimitives[slot];
+        }
+    }
+
+    if (nearest < 0)
+    {
+        return false;
+    }
+
+    hit.t = tMax;
+    hit.sphere = &(*spheres)[primitiveIndices[nearest]];
+    ComputeNormal(ray, hit);
+    return true;
+}
+
+bool Bvh::AnyHit(const Ray& ray, float tMin, float tMax, bool cullBehindOrigin) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+    uint32_t stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const WideBvhNode& node = nodes[stack[--stackSize]];
+        float entry[WideBvhNode::kWidth];
+        uint32_t mask = IntersectChildren(node, ray.origin, inverseDirection, tMin, tMax, entry);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        uint32_t targets[WideBvhNode::kWidth];
+        node.ChildTargets(targets);
+        for (uint32_t slot = 0; mask != 0; ++slot, mask >>= 1)
+        {
+            if ((mask & 1) == 0)
+            {
+                continue;
+            }
+            if (!node.IsLeafChild(slot))
+            {
+                stack[stackSize++] = targets[slot];
+            }
+            else if (IntersectAnyWide(leafSpheres, targets[slot], node.childPrimitives[slot], ray, tMin, tMax, cullBehindOrigin))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void PrintBvhStats(const BvhStats& stats)
+{
+    const char* builderName = stats.builder == BvhBuilder::Morton ? (stats.treelets ? "Morton builder with treelets" : "Morton builder") : "SAH builder";
+    printf("BVH: %u nodes (%u-wide), %u leaves, depth %u, SAH cost %.1f, %.1f KiB, %s, built in %.2f ms (%s leaf kernel)\n",
+        stats.nodeCount, stats.width, stats.leafCount, stats.maxDepth, stats.sahCost, stats.memoryBytes / 1024.0, builderName, stats.buildMs, SphereKernelName());
+    const BvhBuildPhases& phases = stats.phases;
+    if (phases.boundsMs > 0.0 && stats.builder == BvhBuilder::Morton)
+    {
+        printf("  Morton build phases: bounds %.2f ms, sort %.2f ms, emit %.2f ms, treelets %.2f ms, collapse %.2f ms, leaves %.2f ms\n",
+            phases.boundsMs, phases.sortMs, phases.emitMs, phases.treeletsMs, phases.collapseMs, phases.leavesMs);
+    }
+    else if (phases.boundsMs > 0.0)
+    {
+        printf("  build phases: bounds %.2f ms, top %.2f ms, subtrees %.2f ms, splice %.2f ms, collapse %.2f ms, leaves %.2f ms\n",
+            phases.boundsMs, phases.topMs, phases.subtreesMs, phases.spliceMs, phases.collapseMs, phases.leavesMs);
+    }
+}
@@ -0,0 +1,248 @@
+// Bvh.h
+
+#pragma once
+
+#include "Intersect.h"
+#include "SphereSoA.h"
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+class Aabb
+{
+public:
+    Aabb()
+        : min(FLT_MAX)
+        , max(-FLT_MAX)
+    {}
+
+    void Grow(const Vector3& point)
+    {
+        min = Vector3{ Min(min.x, point.x), Min(min.y, point.y), Min(min.z, point.z) };
+        max = Vector3{ Max(max.x, point.x), Max(max.y, point.y), Max(max.z, point.z) };
+    }
+
+    // An empty rhs leaves the box as it is
+    void Grow(const Aabb& rhs)
+    {
+        min = Vector3{ Min(min.x, rhs.min.x), Min(min.y, rhs.min.y), Min(min.z, rhs.min.z) };
+        max = Vector3{ Max(max.x, rhs.max.x), Max(max.y, rhs.max.y), Max(max.z, rhs.max.z) };
+    }
+
+    float SurfaceArea() const
+    {
+        Vector3 extent = max - min;
+        return extent.x < 0.0f ? 0.0f : 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    Vector3 min;
+    Vector3 max;
+};
+
+inline Aabb SphereBounds(const Sphere& sphere)
+{
+    Aabb bounds;
+    bounds.min = sphere.center - Vector3(sphere.radius);
+    bounds.max = sphere.center + Vector3(sphere.radius);
+    return bounds;
+}
+
+// Slab test; returns the entry distance, or FLT_MAX if the box is missed or
+// lies outside [tMin, tMax].
+inline float IntersectAabb(const Vector3& origin, const Vector3& inverseDirection, const Aabb& bounds, float tMin, float tMax)
+{
+    float tx0 = (bounds.min.x - origin.x) * inverseDirection.x;
+    float tx1 = (bounds.max.x - origin.x) * inverseDirection.x;
+    float ty0 = (bounds.min.y - origin.y) * inverseDirection.y;
+    float ty1 = (bounds.max.y - origin.y) * inverseDirection.y;
+    float tz0 = (bounds.min.z - origin.z) * inverseDirection.z;
+    float tz1 = (bounds.max.z - origin.z) * inverseDirection.z;
+
+    float tEntry = Max(Max(Min(tx0, tx1), Min(ty0, ty1)), Max(Min(tz0, tz1), tMin));
+    float tExit = Min(Min(Max(tx0, tx1), Max(ty0, ty1)), Min(Max(tz0, tz1), tMax));
+    return tEntry <= tExit ? tEntry : FLT_MAX;
+}
+
+// 32-byte node of a binary hierarchy, as built by the SAH builder and used
+// by TriangleBvh. Interior nodes store the index of their left child in
+// leftFirst (the right child follows it); leaves store the first entry of
+// the primitive index array and a non-zero count.
+class BvhNode
+{
+public:
+    bool IsLeaf() const
+    {
+        return count > 0;
+    }
+
+    Aabb     bounds;
+    uint32_t leftFirst;
+    uint32_t count;
+};
+
+// 80-byte node of the 8-wide sphere hierarchy. Child boxes are 8-bit
+// coordinates on a grid anchored at origin, with a power-of-two step per
+// axis, rounded outward so they always contain the exact box. Interior
+// children are consecutive nodes from childBase; the spheres of the leaf
+// children are consecutive leaf entries from primitiveBase, in slot order.
+// Slots past childCount are unused.
+class WideBvhNode
+{
+public:
+    static const uint32_t kWidth = 8;
+
+    bool IsLeafChild(uint32_t slot) const
+    {
+        return childPrimitives[slot] > 0;
+    }
+
+    // Per used slot: the child's node index, or its first leaf entry
+    void ChildTargets(uint32_t* targets) const
+    {
+        uint32_t nextNode = childBase;
+        uint32_t nextPrimitive = primitiveBase;
+        for (uint32_t slot = 0; slot < childCount; ++slot)
+        {
+            targets[slot] = IsLeafChild(slot) ? nextPrimitive : nextNode++;
+            nextPrimitive += childPrimitives[slot];
+        }
+    }
+
+    Vector3  origin;
+    int8_t   exponents[3];
+    uint8_t  childCount;
+    uint32_t childBase;
+    uint32_t primitiveBase;
+    uint8_t  childPrimitives[kWidth]; // 0 for an interior child, else the leaf's sphere count
+    uint8_t  lowerX[kWidth];
+    uint8_t  lowerY[kWidth];
+    uint8_t  lowerZ[kWidth];
+    uint8_t  upperX[kWidth];
+    uint8_t  upperY[kWidth];
+    uint8_t  upperZ[kWidth];
+};
+static_assert(sizeof(WideBvhNode) == 80, "WideBvhNode is part of the scene cache layout");
+
+// 2^exponent for the exponents a WideBvhNode stores, [-126, 127]
+inline float GridStep(int8_t exponent)
+{
+    uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+    float step;
+    memcpy(&step, &bits, sizeof(step));
+    return step;
+}
+
+// Decoded (conservative) box of one child
+inline Aabb WideChildBounds(const WideBvhNode& node, uint32_t slot)
+{
+    Vector3 step{ GridStep(node.exponents[0]), GridStep(node.exponents[1]), GridStep(node.exponents[2]) };
+    Aabb bounds;
+    bounds.min = node.origin + Vector3{ static_cast<float>(node.lowerX[slot]), static_cast<float>(node.lowerY[slot]), static_cast<float>(node.lowerZ[slot]) } * step;
+    bounds.max = node.origin + Vector3{ static_cast<float>(node.upperX[slot]), static_cast<float>(node.upperY[slot]), static_cast<float>(node.upperZ[slot]) } * step;
+    return bounds;
+}
+
+// Children of node hit by any of rayCount rays sharing an origin, given
+// per-ray inverse directions and far limits. Returns their slots as a bit
+// mask and the nearest entry distance over the rays for each slot.
+uint32_t IntersectChildrenPacket(const WideBvhNode& node, const Vector3& origin, const float* inverseX, const float* inverseY, const float* inverseZ, uint32_t rayCount, float tMin, const float* tMax, float* nearestEntry);
+
+// How Bvh builds its binary tree before collapsing it
+enum class BvhBuilder
+{
+    Sah,    // Binned surface area heuristic (see BuildBvhNodes)
+    Morton, // Linear BVH from sorted Morton codes (see BuildMortonNodes)
+};
+
+// Wall-clock time of each build phase; phases a hierarchy does not have
+// stay 0. SAH builds fill the top, subtree and splice phases, Morton builds
+// the sort, emit and treelet phases.
+class BvhBuildPhases
+{
+public:
+    double boundsMs = 0.0;   // Primitive boxes, plus Morton codes
+    double topMs = 0.0;      // Top levels, split one node at a time with parallel binning
+    double subtreesMs = 0.0; // Remaining subtrees, one thread pool task each
+    double spliceMs = 0.0;   // Subtrees joined into one node array
+    double sortMs = 0.0;     // Parallel radix sort of the Morton codes
+    double emitMs = 0.0;     // Tree split from the sorted codes and its boxes
+    double treeletsMs = 0.0; // Optional treelet restructuring
+    double collapseMs = 0.0; // Binary tree collapsed into wide nodes
+    double leavesMs = 0.0;   // Leaf primitives copied in leaf order
+};
+
+class BvhStats
+{
+public:
+    uint32_t       width = 2; // Children per node
+    uint32_t       nodeCount = 0;
+    uint32_t       leafCount = 0;
+    uint32_t       maxDepth = 0;
+    size_t         memoryBytes = 0;
+    // SAH cost of a subtree: visiting its root plus the cost of each child,
+    // weighted by the chance that a ray through the root hits the child.
+    // This is the mean over the interior nodes weighted by their primitive
+    // counts, from the exact boxes. The root's cost alone is swamped by one
+    // huge primitive such as a floor; the mean tracks how loose a refit
+    // tree has become wherever the primitives move.
+    float          sahCost = 0.0f;
+    double         buildMs = 0.0;
+    BvhBuilder     builder = BvhBuilder::Sah;
+    bool           treelets = false; // Morton tree restructured by treelet optimization
+    BvhBuildPhases phases;
+    float          refitSahCost = 0.0f; // sahCost after the last refit, kept across an Update's rebuild
+    double         refitMs = 0.0;
+};
+
+// Bounding volume hierarchy over a sphere list. A binary tree is built by
+// the selected builder and then collapsed into 8-wide nodes with quantized
+// child boxes, whose children are tested against a ray in one SIMD pass. Leaves
+// hold up to a few SIMD widths of spheres, stored in leaf order in
+// leafSpheres and tested with the wide kernels. The sphere vector must
+// outlive the hierarchy and must not be reallocated while it is in use.
+// Every array may view a mapped scene cache instead of owning its data.
+//
+// When spheres move or change radius but none are added or removed, Refit
+// brings the boxes up to date far faster than a rebuild. The tree keeps
+// the grouping it was built with, so its quality decays as the spheres
+// drift apart; Update refits and rebuilds only once that decay is too high.
+class Bvh
+{
+public:
+    // threadCount <= 0 uses every hardware thread
+    void Build(const Buffer<Sphere>& inSpheres, int threadCount = 0);
+
+    // Recomputes every box bottom-up from the current spheres, a tree level
+    // at a time with each level's nodes in parallel, and refreshes
+    // leafSpheres and stats.sahCost. The topology and leaf order are kept.
+    void Refit(int threadCount = 0);
+
+    // Refits, then rebuilds if the refit tree's SAH cost exceeds builtSahCost
+    // by more than rebuildRatio. Returns true if it rebuilt.
+    bool Update(int threadCount = 0, float rebuildRatio = 1.5f);
+
+    // Drops the hierarchy and its stats, leaving it as if never built; unlike
+    // building an empty sphere list, no thread pool is touched
+    void Clear();
+
+    // Nodes, indices and leaf spheres, whether owned or mapped
+    size_t MemoryBytes() const;
+
+    bool ClosestHit(const Ray& ray, float tMin, float tMax, HitRecord& hit) const;
+    bool AnyHit(const Ray& ray, float tMin, float tMax, bool cullBehindOrigin) const;
+
+    // Used by Build and by Update's rebuilds. Morton trees build several
+    // times faster and trace somewhat slower; treelet restructuring (Morton
+    // only) recovers part of the difference for a little more build time.
+    BvhBuilder            builder = BvhBuilder::Sah;
+    bool                  optimizeTreelets = false;
+
+    Buffer<WideBvhNode>   nodes; // Root first
+    Buffer<uint32_t>      primitiveIndices;
+    SphereSoA             leafSpheres;
+    const Buffer<Sphere>* spheres = nullptr;
+    BvhStats              stats;
+    float                 builtSahCost = 0.0f; // stats.sahCost right after the last build
+};
+
+void PrintBvhStats(const BvhStats& stats);
@@ -0,0 +1,1038 @@
+// BvhBuilder.h
+//
+// Internal to the hierarchy builds: the binned SAH builder shared by the
+// sphere and triangle hierarchies, and the Morton-code linear builder.
+// Primitives supplies Aabb Bounds(uint32_t) for the primitive with a given
+// index; primitives are split by the centers of their boxes.
+
+#pragma once
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace BvhBuild
+{
+
+const float kTraversalCost = 1.0f;
+const float kIntersectionCost = 1.0f;
+const uint32_t kLeafWidth = SphereSoA::kWidth;
+const uint32_t kMaxLeafSize = 2 * kLeafWidth;
+const uint32_t kMaxDepth = 48;
+
+// Candidate split planes per axis are the boundaries between this many
+// equal bins over the centers' extent
+const uint32_t kBinCount = 16;
+
+// Morton codes take 10 bits per axis up to this many primitives and 21
+// above it, where the coarser grid would leave many codes shared
+const uint32_t kMaxShortCodePrimitives = 1 << 16;
+
+// Primitives whose box is longer than this fraction of the largest extent
+// of all centers get a Morton subtree of their own
+const float kOversizedFraction = 0.25f;
+
+// Radix sort digit
+const uint32_t kRadixBits = 11;
+const uint32_t kRadixSize = 1 << kRadixBits;
+
+// Leaves of a treelet restructured at once by the optional Morton pass
+const uint32_t kTreeletLeaves = 5;
+
+// The treelet pass hands subtrees this many levels below the root to
+// thread pool tasks
+const uint32_t kTreeletTaskDepth = 6;
+
+// Subtrees at most this large are built as one thread pool task
+const uint32_t kMinTaskSize = 1 << 12;
+
+// Top-level nodes at least this large are bounded and binned by several
+// thread pool tasks of kChunkSize primitives each
+const uint32_t kParallelBinSize = 1 << 16;
+const uint32_t kChunkSize = 1 << 14;
+
+inline double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+class Bin
+{
+public:
+    Aabb     bounds;
+    uint32_t count = 0;
+};
+
+// Bins of one range along each axis
+class Bins
+{
+public:
+    void Merge(const Bins& rhs)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (uint32_t bin = 0; bin < kBinCount; ++bin)
+            {
+                bins[axis][bin].bounds.Grow(rhs.bins[axis][bin].bounds);
+                bins[axis][bin].count += rhs.bins[axis][bin].count;
+            }
+        }
+    }
+
+    Bin bins[3][kBinCount];
+};
+
+// One builder's view of the shared index array plus the nodes it creates.
+// The top of the tree is built by one context that defers subtrees of at
+// most taskSize primitives; each deferred subtree then gets its own
+// context, so tasks share nothing but disjoint ranges of the index array.
+// A task's node array is its arena: reserved once for the worst case of two
+// nodes per primitive, so building never reallocates and every task
+// allocates from memory of its own.
+class Context
+{
+public:
+    Context(const std::vector<Aabb>& inBounds, Buffer<uint32_t>& inIndices)
+        : bounds(inBounds)
+        , indices(inIndices)
+    {}
+
+    // Split position of a primitive; derived from its box rather than stored,
+    // which would cost another 12 bytes per primitive of build scratch
+    Vector3 Center(uint32_t index) const
+    {
+        return (bounds[index].min + bounds[index].max) * 0.5f;
+    }
+
+    const std::vector<Aabb>&    bounds; // Per primitive
+    Buffer<uint32_t>&           indices;
+    std::vector<BvhNode>        nodes;
+    uint32_t                    leafCount = 0;
+    uint32_t                    maxDepth = 0;
+
+    // Set for the top context only: its large nodes are binned in parallel
+    ThreadPool*                 pool = nullptr;
+
+    // Nodes left for tasks, with their depths; only used while taskSize > 0
+    uint32_t                    taskSize = 0;
+    std::vector<uint32_t>       deferredNodes;
+    std::vector<uint32_t>       deferredDepths;
+};
+
+// Primitives in a leaf are tested a SIMD width at a time
+inline float LeafCost(uint32_t count)
+{
+    return kIntersectionCost * ((count + kLeafWidth - 1) / kLeafWidth);
+}
+
+inline float Axis(const Vector3& v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// SAH cost of the tree as BvhStats defines it. Children always follow
+// their parent, so one pass from the back visits every subtree bottom-up.
+inline float SahCost(const Buffer<BvhNode>& nodes)
+{
+    std::vector<float> costs(nodes.size());
+    std::vector<uint32_t> sizes(nodes.size());
+    double cost = 0.0;
+    double size = 0.0;
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        const BvhNode& node = nodes[i];
+        if (node.IsLeaf())
+        {
+            costs[i] = LeafCost(node.count);
+            sizes[i] = node.count;
+            continue;
+        }
+
+        float area = node.bounds.SurfaceArea();
+        costs[i] = kTraversalCost;
+        sizes[i] = 0;
+        for (uint32_t child = node.leftFirst; child < node.leftFirst + 2; ++child)
+        {
+            costs[i] += (area > 0.0f ? nodes[child].bounds.SurfaceArea() / area : 1.0f) * costs[child];
+            sizes[i] += sizes[child];
+        }
+        cost += static_cast<double>(costs[i]) * sizes[i];
+        size += sizes[i];
+    }
+    return size > 0.0 ? static_cast<float>(cost / size) : 0.0f;
+}
+
+// Maps a center to its bin along one axis; binning and partitioning must
+// agree exactly, so both go through here
+class BinMapping
+{
+public:
+    uint32_t Bin(const Vector3& center, int axis) const
+    {
+        float position = (Axis(center, axis) - Axis(origin, axis)) * Axis(scale, axis);
+        return std::min(static_cast<uint32_t>(Max(position, 0.0f)), kBinCount - 1);
+    }
+
+    Vector3 origin;
+    Vector3 scale; // kBinCount / extent, or 0 along a flat axis
+};
+
+// Runs body(first, last) over [first, first + count), split across the
+// top context's pool when the range is large enough
+template< typename Body >
+void ForChunks(const Context& context, uint32_t first, uint32_t count, const Body& body)
+{
+    if (!context.pool || count < kParallelBinSize)
+    {
+        body(first, first + count, 0u);
+        return;
+    }
+
+    uint32_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    context.pool->ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t chunkFirst = first + chunk * kChunkSize;
+        body(chunkFirst, std::min(chunkFirst + kChunkSize, first + count), chunk);
+    });
+}
+
+inline Aabb CenterBounds(const Context& context, uint32_t first, uint32_t count)
+{
+    std::vector<Aabb> chunkBounds(context.pool && count >= kParallelBinSize ? (count + kChunkSize - 1) / kChunkSize : 1);
+    ForChunks(context, first, count, [&](uint32_t chunkFirst, uint32_t chunkLast, uint32_t chunk)
+    {
+        Aabb bounds;
+        for (uint32_t i = chunkFirst; i < chunkLast; ++i)
+        {
+            bounds.Grow(context.Center(context.indices[i]));
+        }
+        chunkBounds[chunk] = bounds;
+    });
+
+    Aabb bounds;
+    for (const Aabb& chunk : chunkBounds)
+    {
+        bounds.Grow(chunk);
+    }
+    return bounds;
+}
+
+inline void BinRange(const Context& context, uint32_t first, uint32_t count, const BinMapping& mapping, Bins& bins)
+{
+    std::vector<Bins> chunkBins(context.pool && count >= kParallelBinSize ? (count + kChunkSize - 1) / kChunkSize : 1);
+    ForChunks(context, first, count, [&](uint32_t chunkFirst, uint32_t chunkLast, uint32_t chunk)
+    {
+        Bins& local = chunkBins[chunk];
+        for (uint32_t i = chunkFirst; i < chunkLast; ++i)
+        {
+            uint32_t index = context.indices[i];
+            Vector3 center = context.Center(index);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                Bin& bin = local.bins[axis][mapping.Bin(center, axis)];
+                bin.bounds.Grow(context.bounds[index]);
+                ++bin.count;
+            }
+        }
+    });
+
+    // Merged in chunk order, so the result does not depend on the pool
+    bins = chunkBins[0];
+    for (size_t chunk = 1; chunk < chunkBins.size(); ++chunk)
+    {
+        bins.Merge(chunkBins[chunk]);
+    }
+}
+
+inline Aabb RangeBounds(const Context& context, uint32_t first, uint32_t count)
+{
+    Aabb bounds;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        bounds.Grow(context.bounds[context.indices[i]]);
+    }
+    return bounds;
+}
+
+inline void Subdivide(Context& context, uint32_t nodeIndex, uint32_t depth)
+{
+    // Copy out fields; nodes may reallocate below
+    uint32_t first = context.nodes[nodeIndex].leftFirst;
+    uint32_t count = context.nodes[nodeIndex].count;
+    if (count <= context.taskSize)
+    {
+        context.deferredNodes.push_back(nodeIndex);
+        context.deferredDepths.push_back(depth);
+        return;
+    }
+
+    context.maxDepth = std::max(context.maxDepth, depth);
+    if (count <= 1 || depth >= kMaxDepth)
+    {
+        ++context.leafCount;
+        return;
+    }
+
+    // Binned SAH: evaluate the plane between every pair of adjacent bins
+    Aabb centerBounds = CenterBounds(context, first, count);
+    Vector3 extent = centerBounds.max - centerBounds.min;
+    BinMapping mapping;
+    mapping.origin = centerBounds.min;
+    mapping.scale = Vector3{ extent.x > 0.0f ? kBinCount / extent.x : 0.0f, extent.y > 0.0f ? kBinCount / extent.y : 0.0f, extent.z > 0.0f ? kBinCount / extent.z : 0.0f };
+
+    float parentArea = context.nodes[nodeIndex].bounds.SurfaceArea();
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    Aabb bestLeft;
+    Aabb bestRight;
+    uint32_t bestLeftCount = 0;
+    if (extent.x > 0.0f || extent.y > 0.0f || extent.z > 0.0f)
+    {
+        Bins bins;
+        BinRange(context, first, count, mapping, bins);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (Axis(extent, axis) <= 0.0f)
+            {
+                continue;
+            }
+
+            const Bin* axisBins = bins.bins[axis];
+            Aabb rightBounds[kBinCount];
+            uint32_t rightCounts[kBinCount];
+            Aabb right;
+            uint32_t rightCount = 0;
+            for (uint32_t split = kBinCount - 1; split > 0; --split)
+            {
+                right.Grow(axisBins[split].bounds);
+                rightCount += axisBins[split].count;
+                rightBounds[split] = right;
+                rightCounts[split] = rightCount;
+            }
+
+            Aabb left;
+            uint32_t leftCount = 0;
+            for (uint32_t split = 1; split < kBinCount; ++split)
+            {
+                left.Grow(axisBins[split - 1].bounds);
+                leftCount += axisBins[split - 1].count;
+                if (leftCount == 0 || rightCounts[split] == 0)
+                {
+                    continue;
+                }
+
+                float cost = kTraversalCost + (left.SurfaceArea() * LeafCost(leftCount) + rightBounds[split].SurfaceArea() * LeafCost(rightCounts[split])) / parentArea;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                    bestLeft = left;
+                    bestRight = rightBounds[split];
+                    bestLeftCount = leftCount;
+                }
+            }
+        }
+    }
+
+    float leafCost = LeafCost(count);
+    if (bestCost >= leafCost && count <= kMaxLeafSize)
+    {
+        ++context.leafCount;
+        return;
+    }
+
+    if (bestAxis >= 0)
+    {
+        uint32_t* begin = context.indices.begin() + first;
+        std::partition(begin, begin + count, [&](uint32_t index)
+        {
+            return mapping.Bin(context.Center(index), bestAxis) < bestSplit;
+        });
+    }
+    else
+    {
+        // Every center coincides: split the range in half
+        bestLeftCount = count / 2;
+        bestLeft = RangeBounds(context, first, bestLeftCount);
+        bestRight = RangeBounds(context, first + bestLeftCount, count - bestLeftCount);
+    }
+
+    uint32_t leftIndex = static_cast<uint32_t>(context.nodes.size());
+    BvhNode left;
+    left.leftFirst = first;
+    left.count = bestLeftCount;
+    left.bounds = bestLeft;
+
+    BvhNode right;
+    right.leftFirst = first + bestLeftCount;
+    right.count = count - bestLeftCount;
+    right.bounds = bestRight;
+
+    context.nodes.push_back(left);
+    context.nodes.push_back(right);
+    context.nodes[nodeIndex].leftFirst = leftIndex;
+    context.nodes[nodeIndex].count = 0;
+
+    Subdivide(context, leftIndex, depth + 1);
+    Subdivide(context, leftIndex + 1, depth + 1);
+}
+
+} // namespace BvhBuild
+
+// Builds a binary SAH hierarchy over primitiveCount primitives. The
+// primitives' boxes are gathered in parallel; the top of the tree is split
+// serially, binning its large nodes in parallel, down to a few subtrees per
+// thread, which are then built as independent tasks and spliced in. The
+// result does not depend on the thread count. Fills the tree statistics and
+// stats.phases except collapseMs and leavesMs.
+template< typename Primitives >
+void BuildBvhNodes(const Primitives& primitives, uint32_t primitiveCount, int threadCount, Buffer<BvhNode>& nodes, Buffer<uint32_t>& primitiveIndices, BvhStats& stats)
+{
+    using namespace BvhBuild;
+
+    nodes.clear();
+    primitiveIndices.resize(primitiveCount);
+    if (primitiveCount == 0)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool& pool = SharedThreadPool(threadCount);
+    std::vector<Aabb> bounds(primitiveCount);
+    uint32_t chunkCount = (primitiveCount + kChunkSize - 1) / kChunkSize;
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kChunkSize;
+        uint32_t last = std::min(first + kChunkSize, primitiveCount);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            bounds[i] = primitives.Bounds(i);
+            primitiveIndices[i] = i;
+        }
+    });
+    stats.phases.boundsMs = MillisecondsSince(start);
+
+    // Build the top of the tree, leaving a few subtrees per thread
+    start = std::chrono::steady_clock::now();
+    Context top(bounds, primitiveIndices);
+    top.pool = &pool;
+    top.taskSize = std::max(kMinTaskSize, primitiveCount / (4 * static_cast<uint32_t>(pool.ThreadCount())));
+    BvhNode root;
+    root.leftFirst = 0;
+    root.count = primitiveCount;
+    root.bounds = Aabb();
+    std::vector<Aabb> chunkBounds(chunkCount);
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kChunkSize;
+        uint32_t last = std::min(first + kChunkSize, primitiveCount);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            chunkBounds[chunk].Grow(bounds[i]);
+        }
+    });
+    for (const Aabb& chunk : chunkBounds)
+    {
+        root.bounds.Grow(chunk);
+    }
+    top.nodes.push_back(root);
+    if (primitiveCount <= top.taskSize)
+    {
+        top.taskSize = 0;
+    }
+    Subdivide(top, 0, 0);
+    stats.phases.topMs = MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    uint32_t taskCount = static_cast<uint32_t>(top.deferredNodes.size());
+    std::vector<std::unique_ptr<Context>> tasks(taskCount);
+    pool.ParallelFor(taskCount, [&](uint32_t taskIndex, int)
+    {
+        const BvhNode& taskRoot = top.nodes[top.deferredNodes[taskIndex]];
+        tasks[taskIndex].reset(new Context(bounds, primitiveIndices));
+        Context& task = *tasks[taskIndex];
+        task.nodes.reserve(2 * static_cast<size_t>(taskRoot.count));
+        task.nodes.push_back(taskRoot);
+        Subdivide(task, 0, top.deferredDepths[taskIndex]);
+    });
+    stats.phases.subtreesMs = MillisecondsSince(start);
+
+    // Splice each subtree in place of its deferred node. Task node k > 0
+    // lands at base + k, which keeps sibling pairs adjacent.
+    start = std::chrono::steady_clock::now();
+    size_t nodeCount = top.nodes.size();
+    for (const std::unique_ptr<Context>& task : tasks)
+    {
+        nodeCount += task->nodes.size() - 1;
+    }
+    nodes.reserve(nodeCount);
+    for (const BvhNode& node : top.nodes)
+    {
+        nodes.push_back(node);
+    }
+    stats.leafCount = top.leafCount;
+    stats.maxDepth = top.maxDepth;
+    for (uint32_t taskIndex = 0; taskIndex < taskCount; ++taskIndex)
+    {
+        const Context& task = *tasks[taskIndex];
+        uint32_t base = static_cast<uint32_t>(nodes.size()) - 1;
+        for (size_t k = 0; k < task.nodes.size(); ++k)
+        {
+            BvhNode node = task.nodes[k];
+            if (!node.IsLeaf())
+            {
+                node.leftFirst += base;
+            }
+            if (k == 0)
+            {
+                nodes[top.deferredNodes[taskIndex]] = node;
+            }
+            else
+            {
+                nodes.push_back(node);
+            }
+        }
+        stats.leafCount += task.leafCount;
+        stats.maxDepth = std::max(stats.maxDepth, task.maxDepth);
+    }
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.sahCost = SahCost(nodes);
+    stats.phases.spliceMs = MillisecondsSince(start);
+}
+
+namespace BvhBuild
+{
+
+class MortonEntry
+{
+public:
+    uint64_t code;
+    uint32_t index;
+};
+
+// The low 21 bits of value with two zero bits inserted after each
+inline uint64_t SpreadBits(uint32_t value)
+{
+    uint64_t x = value & 0x1fffffu;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+// Interleaved bits of a point's cell on a grid over bounds with
+// 2^bitsPerAxis cells per axis; points outside bounds take the nearest cell
+inline uint64_t MortonCode(const Vector3& point, const Aabb& bounds, uint32_t bitsPerAxis)
+{
+    Vector3 extent = bounds.max - bounds.min;
+    float cells = static_cast<float>(1u << bitsPerAxis);
+    uint32_t maxCell = (1u << bitsPerAxis) - 1;
+    auto cell = [&](int axis)
+    {
+        float size = Axis(extent, axis);
+        float position = size > 0.0f ? (Axis(point, axis) - Axis(bounds.min, axis)) / size * cells : 0.0f;
+        return static_cast<uint32_t>(Min(Max(position, 0.0f), static_cast<float>(maxCell)));
+    };
+    return SpreadBits(cell(0)) << 2 | SpreadBits(cell(1)) << 1 | SpreadBits(cell(2));
+}
+
+inline int HighestBit(uint64_t value)
+{
+    int bit = 0;
+    for (int shift = 32; shift > 0; shift >>= 1)
+    {
+        if (value >> shift)
+        {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+// Stable least-significant-digit radix sort by the low codeBits bits of
+// the codes. Each pass counts digits in fixed-size chunks in parallel, then
+// scatters the chunks in parallel to offsets from the counts, so the result
+// does not depend on the thread count.
+inline void RadixSort(std::vector<MortonEntry>& entries, uint32_t codeBits, ThreadPool& pool)
+{
+    uint32_t count = static_cast<uint32_t>(entries.size());
+    uint32_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    std::vector<MortonEntry> scratch(count);
+    std::vector<uint32_t> offsets(static_cast<size_t>(chunkCount) * kRadixSize);
+    for (uint32_t shift = 0; shift < codeBits; shift += kRadixBits)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0u);
+        pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+        {
+            uint32_t* chunkOffsets = &offsets[static_cast<size_t>(chunk) * kRadixSize];
+            uint32_t last = std::min((chunk + 1) * kChunkSize, count);
+            for (uint32_t i = chunk * kChunkSize; i < last; ++i)
+            {
+                ++chunkOffsets[(entries[i].code >> shift) & (kRadixSize - 1)];
+            }
+        });
+
+        // Digit-major exclusive sum: every chunk's entries follow those of
+        // earlier chunks with the same digit
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < kRadixSize; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                uint32_t& chunkOffset = offsets[static_cast<size_t>(chunk) * kRadixSize + digit];
+                uint32_t digitCount = chunkOffset;
+                chunkOffset = offset;
+                offset += digitCount;
+            }
+        }
+
+        pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+        {
+            uint32_t* chunkOffsets = &offsets[static_cast<size_t>(chunk) * kRadixSize];
+            uint32_t last = std::min((chunk + 1) * kChunkSize, count);
+            for (uint32_t i = chunk * kChunkSize; i < last; ++i)
+            {
+                scratch[chunkOffsets[(entries[i].code >> shift) & (kRadixSize - 1)]++] = entries[i];
+            }
+        });
+        entries.swap(scratch);
+    }
+}
+
+// First entry of [first, last) on the far side of the highest bit in which
+// the range's codes differ; the middle if they are all equal
+inline uint32_t MortonSplit(const std::vector<MortonEntry>& entries, uint32_t first, uint32_t last)
+{
+    uint64_t firstCode = entries[first].code;
+    uint64_t lastCode = entries[last - 1].code;
+    if (firstCode == lastCode)
+    {
+        return (first + last) / 2;
+    }
+
+    // The codes are sorted and share every higher bit, so the ones with the
+    // bit set form a suffix
+    uint64_t bit = 1ull << HighestBit(firstCode ^ lastCode);
+    uint32_t low = first;
+    uint32_t high = last - 1;
+    while (low < high)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (entries[middle].code & bit)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+class MortonEmitter
+{
+public:
+    const std::vector<MortonEntry>& entries;
+    Buffer<BvhNode>&                nodes;
+    uint32_t                        leafCount = 0;
+    uint32_t                        maxDepth = 0;
+};
+
+// Splits a node at its Morton split until a leaf fits a SIMD width; bounds
+// are filled in afterwards
+inline void EmitMortonNode(MortonEmitter& emitter, uint32_t nodeIndex, uint32_t depth)
+{
+    uint32_t first = emitter.nodes[nodeIndex].leftFirst;
+    uint32_t count = emitter.nodes[nodeIndex].count;
+    emitter.maxDepth = std::max(emitter.maxDepth, depth);
+    if (count <= kLeafWidth || depth >= kMaxDepth)
+    {
+        ++emitter.leafCount;
+        return;
+    }
+
+    uint32_t split = MortonSplit(emitter.entries, first, first + count);
+    uint32_t leftIndex = static_cast<uint32_t>(emitter.nodes.size());
+    BvhNode left;
+    left.leftFirst = first;
+    left.count = split - first;
+    BvhNode right;
+    right.leftFirst = split;
+    right.count = first + count - split;
+    emitter.nodes.push_back(left);
+    emitter.nodes.push_back(right);
+    emitter.nodes[nodeIndex].leftFirst = leftIndex;
+    emitter.nodes[nodeIndex].count = 0;
+
+    EmitMortonNode(emitter, leftIndex, depth + 1);
+    EmitMortonNode(emitter, leftIndex + 1, depth + 1);
+}
+
+// Treelet restructuring (Karras and Aila, "Fast Parallel Construction of
+// High-Quality Bounding Volume Hierarchies"). costs holds every node's
+// subtree SAH cost, scaled by area rather than relative to the root.
+class TreeletOptimizer
+{
+public:
+    Buffer<BvhNode>&    nodes;
+    std::vector<float>& costs;
+};
+
+// Grows a treelet below an interior node by repeatedly opening its largest
+// interior leaf, finds the binary tree over its leaves with the lowest SAH
+// cost by dynamic programming over leaf subsets, and rewrites the treelet
+// if that tree is cheaper. The treelet's sibling pair slots are reused, so
+// nodes outside it are untouched, but a subtree root moved into a slot may
+// then come before its parent or after its children.
+inline void OptimizeTreelet(TreeletOptimizer& optimizer, uint32_t rootIndex)
+{
+    Buffer<BvhNode>& nodes = optimizer.nodes;
+    std::vector<float>& costs = optimizer.costs;
+
+    uint32_t leaves[kTreeletLeaves];
+    uint32_t pairs[kTreeletLeaves - 1];
+    uint32_t leafCount = 2;
+    uint32_t pairCount = 1;
+    pairs[0] = nodes[rootIndex].leftFirst;
+    leaves[0] = pairs[0];
+    leaves[1] = pairs[0] + 1;
+    while (leafCount < kTreeletLeaves)
+    {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < leafCount; ++i)
+        {
+            float area = nodes[leaves[i]].bounds.SurfaceArea();
+            if (!nodes[leaves[i]].IsLeaf() && area > largestArea)
+            {
+                largest = static_cast<int>(i);
+                largestArea = area;
+            }
+        }
+        if (largest < 0)
+        {
+            break;
+        }
+
+        uint32_t opened = nodes[leaves[largest]].leftFirst;
+        pairs[pairCount++] = opened;
+        leaves[largest] = opened;
+        leaves[leafCount++] = opened + 1;
+    }
+    if (leafCount < 3)
+    {
+        return;
+    }
+
+    // Subsets in increasing order visit every proper subset first
+    const uint32_t kSubsets = 1 << kTreeletLeaves;
+    const uint32_t fullSet = (1u << leafCount) - 1;
+    Aabb subsetBounds[kSubsets];
+    float bestCost[kSubsets];
+    uint8_t bestSplit[kSubsets];
+    for (uint32_t subset = 1; subset <= fullSet; ++subset)
+    {
+        uint32_t lowest = subset & (0u - subset);
+        uint32_t lowestIndex = static_cast<uint32_t>(HighestBit(lowest));
+        subsetBounds[subset] = subsetBounds[subset & (subset - 1)];
+        subsetBounds[subset].Grow(nodes[leaves[lowestIndex]].bounds);
+        if (subset == lowest)
+        {
+            bestCost[subset] = costs[leaves[lowestIndex]];
+            continue;
+        }
+
+        // Each split once: the part holding the lowest leaf goes left
+        float best = FLT_MAX;
+        for (uint32_t part = (subset - 1) & subset; part != 0; part = (part - 1) & subset)
+        {
+            if ((part & lowest) != 0)
+            {
+                float cost = bestCost[part] + bestCost[subset ^ part];
+                if (cost < best)
+                {
+                    best = cost;
+                    bestSplit[subset] = static_cast<uint8_t>(part);
+                }
+            }
+        }
+        bestCost[subset] = kTraversalCost * subsetBounds[subset].SurfaceArea() + best;
+    }
+    if (bestCost[fullSet] >= costs[rootIndex] * 0.999f)
+    {
+        return;
+    }
+
+    BvhNode leafNodes[kTreeletLeaves];
+    float leafCosts[kTreeletLeaves];
+    for (uint32_t i = 0; i < leafCount; ++i)
+    {
+        leafNodes[i] = nodes[leaves[i]];
+        leafCosts[i] = costs[leaves[i]];
+    }
+
+    // Interior nodes of the new treelet take the pair slots in turn
+    uint32_t nextPair = 0;
+    std::function<void(uint32_t, uint32_t)> write = [&](uint32_t slot, uint32_t subset)
+    {
+        if ((subset & (subset - 1)) == 0)
+        {
+            uint32_t i = static_cast<uint32_t>(HighestBit(subset));
+            nodes[slot] = leafNodes[i];
+            costs[slot] = leafCosts[i];
+            return;
+        }
+
+        uint32_t pair = pairs[nextPair++];
+        nodes[slot].bounds = subsetBounds[subset];
+        nodes[slot].leftFirst = pair;
+        nodes[slot].count = 0;
+        costs[slot] = bestCost[subset];
+        write(pair, bestSplit[subset]);
+        write(pair + 1, subset ^ bestSplit[subset]);
+    };
+    write(rootIndex, fullSet);
+}
+
+// Post-order: children are optimized before the treelets above them.
+// Stops at stopDepth, below which costs are already known.
+inline float OptimizeTreelets(TreeletOptimizer& optimizer, uint32_t nodeIndex, uint32_t depth, uint32_t stopDepth)
+{
+    const BvhNode& node = optimizer.nodes[nodeIndex];
+    if (node.IsLeaf())
+    {
+        optimizer.costs[nodeIndex] = node.bounds.SurfaceArea() * LeafCost(node.count);
+        return optimizer.costs[nodeIndex];
+    }
+    if (depth == stopDepth)
+    {
+        return optimizer.costs[nodeIndex];
+    }
+
+    uint32_t left = node.leftFirst;
+    float cost = kTraversalCost * node.bounds.SurfaceArea();
+    cost += OptimizeTreelets(optimizer, left, depth + 1, stopDepth);
+    cost += OptimizeTreelets(optimizer, left + 1, depth + 1, stopDepth);
+    optimizer.costs[nodeIndex] = cost;
+    OptimizeTreelet(optimizer, nodeIndex);
+    return optimizer.costs[nodeIndex];
+}
+
+} // namespace BvhBuild
+
+// Builds a binary linear BVH over primitiveCount primitives: Morton codes
+// of the box centers are radix sorted in parallel and the sorted range is
+// split recursively at the highest bit in which its codes differ, down to
+// leaves of one SIMD width. Several times faster to build than
+// BuildBvhNodes and somewhat slower to trace. With optimizeTreelets,
+// treelets of kTreeletLeaves leaves are then restructured for SAH cost,
+// subtrees a few levels down in parallel, which recovers part of the
+// difference. The result does not depend on the thread count.
+// Fills the tree statistics and stats.phases except collapseMs and
+// leavesMs.
+template< typename Primitives >
+void BuildMortonNodes(const Primitives& primitives, uint32_t primitiveCount, int threadCount, bool optimizeTreelets, Buffer<BvhNode>& nodes, Buffer<uint32_t>& primitiveIndices, BvhStats& stats)
+{
+    using namespace BvhBuild;
+
+    nodes.clear();
+    primitiveIndices.resize(primitiveCount);
+    if (primitiveCount == 0)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool& pool = SharedThreadPool(threadCount);
+    uint32_t chunkCount = (primitiveCount + kChunkSize - 1) / kChunkSize;
+    std::vector<Aabb> bounds(primitiveCount);
+    std::vector<Aabb> chunkCenterBounds(chunkCount);
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t last = std::min((chunk + 1) * kChunkSize, primitiveCount);
+        for (uint32_t i = chunk * kChunkSize; i < last; ++i)
+        {
+            bounds[i] = primitives.Bounds(i);
+            chunkCenterBounds[chunk].Grow((bounds[i].min + bounds[i].max) * 0.5f);
+        }
+    });
+    Aabb centerBounds;
+    for (const Aabb& chunk : chunkCenterBounds)
+    {
+        centerBounds.Grow(chunk);
+    }
+
+    // A primitive spanning much of the scene, such as a floor, would stretch
+    // the code grid and the boxes of every node on its path along the curve.
+    // Such primitives are left out of the grid's bounds and get a subtree of
+    // their own below the root.
+    float largestExtent = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        largestExtent = Max(largestExtent, Axis(centerBounds.max - centerBounds.min, axis));
+    }
+    float oversizedExtent = largestExtent * kOversizedFraction;
+    auto fits = [&](uint32_t index)
+    {
+        Vector3 extent = bounds[index].max - bounds[index].min;
+        return Max(Max(extent.x, extent.y), extent.z) <= oversizedExtent;
+    };
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        chunkCenterBounds[chunk] = Aabb();
+        uint32_t last = std::min((chunk + 1) * kChunkSize, primitiveCount);
+        for (uint32_t i = chunk * kChunkSize; i < last; ++i)
+        {
+            if (fits(i))
+            {
+                chunkCenterBounds[chunk].Grow((bounds[i].min + bounds[i].max) * 0.5f);
+            }
+        }
+    });
+    Aabb gridBounds;
+    for (const Aabb& chunk : chunkCenterBounds)
+    {
+        gridBounds.Grow(chunk);
+    }
+
+    uint32_t bitsPerAxis = primitiveCount <= kMaxShortCodePrimitives ? 10 : 21;
+    std::vector<MortonEntry> entries(primitiveCount);
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t last = std::min((chunk + 1) * kChunkSize, primitiveCount);
+        for (uint32_t i = chunk * kChunkSize; i < last; ++i)
+        {
+            entries[i].code = MortonCode((bounds[i].min + bounds[i].max) * 0.5f, gridBounds, bitsPerAxis);
+            entries[i].index = i;
+        }
+    });
+    stats.phases.boundsMs = MillisecondsSince(start);
+
+    // Oversized primitives keep their order at the end
+    start = std::chrono::steady_clock::now();
+    RadixSort(entries, 3 * bitsPerAxis, pool);
+    uint32_t fittingCount = static_cast<uint32_t>(std::stable_partition(entries.begin(), entries.end(), [&](const MortonEntry& entry) { return fits(entry.index); }) - entries.begin());
+    stats.phases.sortMs = MillisecondsSince(start);
+
+    // Topology first, then boxes from the back: children always follow
+    // their parent
+    start = std::chrono::steady_clock::now();
+    nodes.reserve(2 * static_cast<size_t>(primitiveCount / kLeafWidth + 1));
+    BvhNode root;
+    root.leftFirst = 0;
+    root.count = primitiveCount;
+    nodes.push_back(root);
+    MortonEmitter emitter{ entries, nodes };
+    if (fittingCount == 0 || fittingCount == primitiveCount)
+    {
+        EmitMortonNode(emitter, 0, 0);
+    }
+    else
+    {
+        BvhNode fitting;
+        fitting.leftFirst = 0;
+        fitting.count = fittingCount;
+        BvhNode oversized;
+        oversized.leftFirst = fittingCount;
+        oversized.count = primitiveCount - fittingCount;
+        nodes.push_back(fitting);
+        nodes.push_back(oversized);
+        nodes[0].leftFirst = 1;
+        nodes[0].count = 0;
+        EmitMortonNode(emitter, 1, 1);
+        EmitMortonNode(emitter, 2, 1);
+    }
+    for (uint32_t i = 0; i < primitiveCount; ++i)
+    {
+        primitiveIndices[i] = entries[i].index;
+    }
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        BvhNode& node = nodes[i];
+        node.bounds = Aabb();
+        if (node.IsLeaf())
+        {
+            for (uint32_t k = node.leftFirst; k < node.leftFirst + node.count; ++k)
+            {
+                node.bounds.Grow(bounds[primitiveIndices[k]]);
+            }
+        }
+        else
+        {
+            node.bounds.Grow(nodes[node.leftFirst].bounds);
+            node.bounds.Grow(nodes[node.leftFirst + 1].bounds);
+        }
+    }
+    stats.leafCount = emitter.leafCount;
+    stats.maxDepth = emitter.maxDepth;
+    stats.phases.emitMs = MillisecondsSince(start);
+
+    if (optimizeTreelets)
+    {
+        start = std::chrono::steady_clock::now();
+        std::vector<float> costs(nodes.size());
+        TreeletOptimizer optimizer{ nodes, costs };
+
+        // Subtree roots at the task depth, found top-down
+        std::vector<uint32_t> taskRoots;
+        std::function<void(uint32_t, uint32_t)> gather = [&](uint32_t nodeIndex, uint32_t depth)
+        {
+            if (depth == kTreeletTaskDepth || nodes[nodeIndex].IsLeaf())
+            {
+                taskRoots.push_back(nodeIndex);
+                return;
+            }
+            gather(nodes[nodeIndex].leftFirst, depth + 1);
+            gather(nodes[nodeIndex].leftFirst + 1, depth + 1);
+        };
+        gather(0, 0);
+        pool.ParallelFor(static_cast<uint32_t>(taskRoots.size()), [&](uint32_t task, int)
+        {
+            OptimizeTreelets(optimizer, taskRoots[task], 0, UINT32_MAX);
+        });
+        OptimizeTreelets(optimizer, 0, 0, kTreeletTaskDepth);
+
+        // Restructuring moves subtree roots between slots, so a child may
+        // now sit before its parent. Renumbering in depth-first order puts
+        // every child after its parent again, as SahCost expects, and finds
+        // the depth, which restructuring may have increased.
+        std::vector<BvhNode> ordered;
+        ordered.reserve(nodes.size());
+        ordered.push_back(nodes[0]);
+        stats.maxDepth = 0;
+        std::function<void(uint32_t, uint32_t)> renumber = [&](uint32_t orderedIndex, uint32_t depth)
+        {
+            stats.maxDepth = std::max(stats.maxDepth, depth);
+            if (ordered[orderedIndex].IsLeaf())
+            {
+                return;
+            }
+
+            uint32_t left = ordered[orderedIndex].leftFirst;
+            uint32_t orderedLeft = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(nodes[left]);
+            ordered.push_back(nodes[left + 1]);
+            ordered[orderedIndex].leftFirst = orderedLeft;
+            renumber(orderedLeft, depth + 1);
+            renumber(orderedLeft + 1, depth + 1);
+        };
+        renumber(0, 0);
+        std::copy(ordered.begin(), ordered.end(), nodes.begin());
+        stats.phases.treeletsMs = MillisecondsSince(start);
+    }
+
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.sahCost = SahCost(nodes);
+}
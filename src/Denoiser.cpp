@@ -0,0 +1,160 @@
+// Denoiser.cpp
+
+#include "Denoiser.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace
+{
+
+// B3 spline taps of the a-trous kernel
+const float kKernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+// Keeps the demodulated lighting finite on black surfaces
+const float kAlbedoEpsilon = 0.01f;
+
+// Rows per thread pool task
+const int kBandHeight = 16;
+
+class DenoiseImage
+{
+public:
+    explicit DenoiseImage(size_t pixelCount)
+        : lighting(pixelCount)
+        , filtered(pixelCount)
+        , albedo(pixelCount)
+        , normal(pixelCount)
+        , depth(pixelCount)
+    {}
+
+    std::vector<Vector3> lighting;
+    std::vector<Vector3> filtered;
+    std::vector<Vector3> albedo;
+    std::vector<Vector3> normal;
+    std::vector<float>   depth;
+};
+
+Vector3 Demodulate(const Vector3& color, const Vector3& albedo)
+{
+    return { color.x / (albedo.x + kAlbedoEpsilon), color.y / (albedo.y + kAlbedoEpsilon), color.z / (albedo.z + kAlbedoEpsilon) };
+}
+
+Vector3 Remodulate(const Vector3& lighting, const Vector3& albedo)
+{
+    return lighting * (albedo + Vector3(kAlbedoEpsilon));
+}
+
+} // namespace
+
+void Denoise(const AccumulationBuffer& accumulation, Framebuffer& framebuffer, const DenoiseSettings& settings)
+{
+    int width = accumulation.width;
+    int height = accumulation.height;
+    ThreadPool& pool = SharedThreadPool(settings.threadCount);
+    uint32_t bandCount = static_cast<uint32_t>((height + kBandHeight - 1) / kBandHeight);
+    auto forEachBand = [&](const std::function<void(int y0, int y1)>& body)
+    {
+        pool.ParallelFor(bandCount, [&](uint32_t band, int)
+        {
+            int y0 = static_cast<int>(band) * kBandHeight;
+            body(y0, std::min(y0 + kBandHeight, height));
+        });
+    };
+
+    bool hasFeatures = accumulation.HasFeatures();
+    DenoiseImage image(accumulation.sums.size());
+    forEachBand([&](int y0, int y1)
+    {
+        for (size_t index = static_cast<size_t>(y0) * width; index < static_cast<size_t>(y1) * width; ++index)
+        {
+            uint32_t count = accumulation.counts[index];
+            float scale = count > 0 ? 1.0f / static_cast<float>(count) : 0.0f;
+            Vector3 color = accumulation.sums[index] * scale;
+            if (!hasFeatures)
+            {
+                image.lighting[index] = color;
+                image.albedo[index] = Vector3(1.0f - kAlbedoEpsilon);
+                continue;
+            }
+
+            image.albedo[index] = accumulation.albedoSums[index] * scale;
+            image.normal[index] = accumulation.normalSums[index] * scale;
+            image.depth[index] = accumulation.depthSums[index] * scale;
+            image.lighting[index] = Demodulate(color, image.albedo[index]);
+        }
+    });
+
+    float normalScale = 1.0f / (settings.normalSigma * settings.normalSigma);
+    float albedoScale = 1.0f / (settings.albedoSigma * settings.albedoSigma);
+    for (int iteration = 0; hasFeatures && iteration < settings.iterations; ++iteration)
+    {
+        int step = 1 << iteration;
+        float colorSigma = settings.colorSigma / static_cast<float>(step);
+        float colorScale = 1.0f / (colorSigma * colorSigma);
+
+        forEachBand([&](int y0, int y1)
+        {
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    size_t center = static_cast<size_t>(y) * width + x;
+                    const Vector3& lighting = image.lighting[center];
+                    const Vector3& albedo = image.albedo[center];
+                    const Vector3& normal = image.normal[center];
+                    float depthScale = 1.0f / (settings.depthSigma * Max(image.depth[center], 1e-3f) * static_cast<float>(step));
+
+                    Vector3 sum(0.0f);
+                    float weightSum = 0.0f;
+                    for (int ky = 0; ky < 5; ++ky)
+                    {
+                        int sampleY = y + (ky - 2) * step;
+                        if (sampleY < 0 || sampleY >= height)
+                        {
+                            continue;
+                        }
+                        for (int kx = 0; kx < 5; ++kx)
+                        {
+                            int sampleX = x + (kx - 2) * step;
+                            if (sampleX < 0 || sampleX >= width)
+                            {
+                                continue;
+                            }
+
+                            size_t index = static_cast<size_t>(sampleY) * width + sampleX;
+                            Vector3 colorDelta = image.lighting[index] - lighting;
+                            Vector3 normalDelta = image.normal[index] - normal;
+                            Vector3 albedoDelta = image.albedo[index] - albedo;
+                            float depthDelta = (image.depth[index] - image.depth[center]) * depthScale;
+
+                            // One exp for all edge-stopping terms
+                            float exponent = colorDelta.Dot(colorDelta) * colorScale + normalDelta.Dot(normalDelta) * normalScale +
+                                albedoDelta.Dot(albedoDelta) * albedoScale + depthDelta * depthDelta;
+                            float weight = kKernel[kx] * kKernel[ky] * expf(-exponent);
+                            sum = sum + image.lighting[index] * weight;
+                            weightSum += weight;
+                        }
+                    }
+
+                    // The centre tap always has weight, so weightSum > 0
+                    image.filtered[center] = sum * (1.0f / weightSum);
+                }
+            }
+        });
+        image.lighting.swap(image.filtered);
+    }
+
+    forEachBand([&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t index = static_cast<size_t>(y) * width + x;
+                framebuffer.SetPixel(x, y, Remodulate(image.lighting[index], image.albedo[index]));
+            }
+        }
+    });
+}
@@ -0,0 +1,24 @@
+// Denoiser.h
+
+#pragma once
+
+#include "Framebuffer.h"
+
+class DenoiseSettings
+{
+public:
+    int   iterations = 5;     // Filter levels; level i samples every 2^i-th pixel
+    float colorSigma = 2.0f;  // Lighting difference tolerated at level 0; halves every level
+    float normalSigma = 0.3f;
+    float depthSigma = 0.01f; // Relative to the centre pixel's depth
+    float albedoSigma = 0.1f;
+    int   threadCount = 0;    // 0 uses every hardware thread
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) over the
+// accumulated image, written to framebuffer. Lighting is divided by the
+// albedo before filtering and multiplied back afterwards, so surface colour
+// is not blurred. The albedo, normal and depth features stop the filter at
+// object edges. Needs AccumulationBuffer::EnableFeatures() before the first
+// pass; without features the plain average is written.
+void Denoise(const AccumulationBuffer& accumulation, Framebuffer& framebuffer, const DenoiseSettings& settings = DenoiseSettings());
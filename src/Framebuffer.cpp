@@ -0,0 +1,161 @@
+// Framebuffer.cpp
+
+#include "Framebuffer.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+void AppendU32BigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    static bool tableInitialized = false;
+    if (!tableInitialized)
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        tableInitialized = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void AppendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+    AppendU32BigEndian(out, static_cast<uint32_t>(data.size()));
+    size_t typeOffset = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    AppendU32BigEndian(out, Crc32(out.data() + typeOffset, out.size() - typeOffset));
+}
+
+} // namespace
+
+bool WritePpm(const Framebuffer& framebuffer, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", framebuffer.width, framebuffer.height);
+
+    std::vector<uint8_t> row(static_cast<size_t>(framebuffer.width) * 3);
+    for (int y = 0; y < framebuffer.height; ++y)
+    {
+        for (int x = 0; x < framebuffer.width; ++x)
+        {
+            uint32_t pixel = framebuffer.GetPixel(x, y);
+            row[x * 3 + 0] = static_cast<uint8_t>(pixel >> 16);
+            row[x * 3 + 1] = static_cast<uint8_t>(pixel >> 8);
+            row[x * 3 + 2] = static_cast<uint8_t>(pixel);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    return fclose(file) == 0;
+}
+
+bool WritePng(const Framebuffer& framebuffer, const char* path)
+{
+    // Raw scanlines, each prefixed with filter type 0 (none)
+    size_t stride = static_cast<size_t>(framebuffer.width) * 3 + 1;
+    std::vector<uint8_t> raw(stride * framebuffer.height);
+    for (int y = 0; y < framebuffer.height; ++y)
+    {
+        uint8_t* row = raw.data() + stride * y;
+        row[0] = 0;
+        for (int x = 0; x < framebuffer.width; ++x)
+        {
+            uint32_t pixel = framebuffer.GetPixel(x, y);
+            row[1 + x * 3 + 0] = static_cast<uint8_t>(pixel >> 16);
+            row[1 + x * 3 + 1] = static_cast<uint8_t>(pixel >> 8);
+            row[1 + x * 3 + 2] = static_cast<uint8_t>(pixel);
+        }
+    }
+
+    // zlib stream made of uncompressed (stored) deflate blocks, so no
+    // compression library is needed
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    const size_t kMaxBlockSize = 65535;
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = raw.size() - offset < kMaxBlockSize ? raw.size() - offset : kMaxBlockSize;
+        bool finalBlock = offset + blockSize == raw.size();
+        zlib.push_back(finalBlock ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(blockSize));
+        zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+        zlib.push_back(static_cast<uint8_t>(~blockSize));
+        zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (uint8_t byte : raw)
+    {
+        adlerA = (adlerA + byte) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    AppendU32BigEndian(zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> header;
+    AppendU32BigEndian(header, static_cast<uint32_t>(framebuffer.width));
+    AppendU32BigEndian(header, static_cast<uint32_t>(framebuffer.height));
+    header.push_back(8); // Bit depth
+    header.push_back(2); // Color type: RGB
+    header.push_back(0); // Compression
+    header.push_back(0); // Filter
+    header.push_back(0); // Interlace
+
+    const uint8_t kSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<uint8_t> png(kSignature, kSignature + sizeof(kSignature));
+    AppendChunk(png, "IHDR", header);
+    AppendChunk(png, "IDAT", zlib);
+    AppendChunk(png, "IEND", {});
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    size_t written = fwrite(png.data(), 1, png.size(), file);
+    return fclose(file) == 0 && written == png.size();
+}
+
+bool WriteImage(const Framebuffer& framebuffer, const char* path)
+{
+    size_t length = strlen(path);
+    if (length >= 4 && strcmp(path + length - 4, ".ppm") == 0)
+    {
+        return WritePpm(framebuffer, path);
+    }
+    return WritePng(framebuffer, path);
+}
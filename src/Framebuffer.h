@@ -0,0 +1,175 @@
+// Framebuffer.h
+
+#pragma once
+
+#include "Vector3.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Platform-neutral render target. Pixels are stored top-down, row-major as
+// 0x00RRGGBB so the buffer can be handed to a 32bpp DIB without conversion.
+class Framebuffer
+{
+public:
+    Framebuffer(int inWidth, int inHeight)
+        : width(inWidth)
+        , height(inHeight)
+        , pixels(static_cast<size_t>(inWidth) * static_cast<size_t>(inHeight), 0)
+    {}
+
+    void SetPixel(int x, int y, const Vector3& color)
+    {
+        uint32_t r = static_cast<uint32_t>(Saturate(color.x) * 255.0f);
+        uint32_t g = static_cast<uint32_t>(Saturate(color.y) * 255.0f);
+        uint32_t b = static_cast<uint32_t>(Saturate(color.z) * 255.0f);
+        pixels[static_cast<size_t>(y) * width + x] = (r << 16) | (g << 8) | b;
+    }
+
+    uint32_t GetPixel(int x, int y) const
+    {
+        return pixels[static_cast<size_t>(y) * width + x];
+    }
+
+    int                   width;
+    int                   height;
+    std::vector<uint32_t> pixels;
+};
+
+// Where a pixel's reprojected samples were centred when they landed, in
+// pixels from its centre, and how many there were
+class PixelHistory
+{
+public:
+    float    offsetX = 0.0f;
+    float    offsetY = 0.0f;
+    uint32_t count = 0;
+};
+
+// Float sum of every sample taken per pixel, for progressive rendering.
+// Each pass adds at most one sample to every pixel and then bumps
+// sampleCount; with adaptive sampling converged pixels are skipped, so each
+// pixel also keeps its own count and the luminance moments for its noise
+// estimate.
+class AccumulationBuffer
+{
+public:
+    AccumulationBuffer(int inWidth, int inHeight)
+        : width(inWidth)
+        , height(inHeight)
+        , sampleCount(0)
+        , sums(static_cast<size_t>(inWidth) * static_cast<size_t>(inHeight), Vector3(0.0f))
+        , sumSquares(sums.size(), 0.0f)
+        , counts(sums.size(), 0)
+    {}
+
+    void Reset()
+    {
+        sampleCount = 0;
+        std::fill(sums.begin(), sums.end(), Vector3(0.0f));
+        std::fill(sumSquares.begin(), sumSquares.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        std::fill(albedoSums.begin(), albedoSums.end(), Vector3(0.0f));
+        std::fill(normalSums.begin(), normalSums.end(), Vector3(0.0f));
+        std::fill(depthSums.begin(), depthSums.end(), 0.0f);
+        ClearReused();
+        history.clear();
+    }
+
+    // Turns on the denoiser's guide features; call before the first pass.
+    // The renderer then records the camera hit's albedo, normal and depth
+    // with every sample.
+    void EnableFeatures()
+    {
+        albedoSums.assign(sums.size(), Vector3(0.0f));
+        normalSums.assign(sums.size(), Vector3(0.0f));
+        depthSums.assign(sums.size(), 0.0f);
+    }
+
+    bool HasFeatures() const
+    {
+        return !albedoSums.empty();
+    }
+
+    void AccumulateFeatures(int x, int y, const Vector3& albedo, const Vector3& normal, float depth)
+    {
+        size_t index = static_cast<size_t>(y) * width + x;
+        albedoSums[index] = albedoSums[index] + albedo;
+        normalSums[index] = normalSums[index] + normal;
+        depthSums[index] += depth;
+    }
+
+    // Adds the current pass's sample and returns the running average
+    Vector3 Accumulate(int x, int y, const Vector3& sample)
+    {
+        size_t index = static_cast<size_t>(y) * width + x;
+        Vector3& sum = sums[index];
+        sum = sum + sample;
+        float luminance = Luminance(sample);
+        sumSquares[index] += luminance * luminance;
+        return sum * (1.0f / static_cast<float>(++counts[index]));
+    }
+
+    // True once the pixel has at least minSamples and the standard error of
+    // its mean luminance is within threshold of the mean. The mean is
+    // floored so near-black pixels do not demand unbounded samples.
+    bool Converged(int x, int y, float threshold, uint32_t minSamples) const
+    {
+        size_t index = static_cast<size_t>(y) * width + x;
+        uint32_t count = counts[index];
+        if (count < minSamples || count < 2)
+        {
+            return false;
+        }
+
+        float n = static_cast<float>(count);
+        float mean = Luminance(sums[index]) / n;
+        float variance = Max(sumSquares[index] / n - mean * mean, 0.0f) * n / (n - 1.0f);
+        float standardError = sqrtf(variance / n);
+        return standardError <= threshold * Max(mean, 0.05f);
+    }
+
+    // True if the pixel's samples were reprojected from an earlier view
+    // since the last pass; that pass leaves it alone
+    bool Reused(int x, int y) const
+    {
+        return !reused.empty() && reused[static_cast<size_t>(y) * width + x] != 0;
+    }
+
+    void ClearReused()
+    {
+        reused.clear();
+    }
+
+    uint64_t TotalSamples() const
+    {
+        uint64_t total = 0;
+        for (uint32_t count : counts)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    int                   width;
+    int                   height;
+    uint32_t              sampleCount; // Passes run
+    std::vector<Vector3>  sums;
+    std::vector<float>    sumSquares;  // Sum of squared sample luminance
+    std::vector<uint32_t> counts;      // Samples per pixel
+
+    // Guide features, summed like the color; empty unless enabled
+    std::vector<Vector3>  albedoSums;
+    std::vector<Vector3>  normalSums;
+    std::vector<float>    depthSums;
+
+    // Set by Reproject; reused is cleared by the next pass, history by
+    // Reset. Both are empty otherwise.
+    std::vector<uint8_t>      reused;
+    std::vector<PixelHistory> history;
+};
+
+// Image writers; return false if the file could not be written.
+bool WritePpm(const Framebuffer& framebuffer, const char* path);
+bool WritePng(const Framebuffer& framebuffer, const char* path);
+bool WriteImage(const Framebuffer& framebuffer, const char* path);
@@ -0,0 +1,27 @@
+// Geometry.h
+
+#pragma once
+
+#include "Vector3.h"
+
+class Ray
+{
+public:
+    Vector3 origin;
+    Vector3 direction;
+};
+
+class Material
+{
+public:
+    Vector3 color;
+    float   roughness;
+};
+
+// 16 bytes; the material index lives beside it in Scene::sphereMaterials
+class Sphere
+{
+public:
+    Vector3 center;
+    float   radius;
+};
@@ -0,0 +1,87 @@
+// Intersect.h
+
+#pragma once
+
+#include "Geometry.h"
+#include <cstdint>
+
+// Fixed-size result of a ray query. Intersect() only fills t and sphere;
+// the normal is filled by ComputeNormal() once the closest hit is known.
+// Triangle hits leave sphere null and fill triangle and the normal directly.
+class HitRecord
+{
+public:
+    float         t;
+    Vector3       normal;
+    const Sphere* sphere;
+    uint32_t      triangle; // Index into Scene::triangles when sphere is null
+};
+
+// Finds the nearest root of the ray/sphere quadratic within [tMin, tMax].
+// Never allocates; returns false if the ray misses the interval.
+inline bool Intersect(const Ray& ray, const Sphere& sphere, float tMin, float tMax, HitRecord& hit)
+{
+    // Half-b form of the quadratic
+    Vector3 rayOriginToSphereCenter = ray.origin - sphere.center;
+    float a = ray.direction.Dot(ray.direction);
+    float halfB = ray.direction.Dot(rayOriginToSphereCenter);
+    float c = rayOriginToSphereCenter.Dot(rayOriginToSphereCenter) - sphere.radius * sphere.radius;
+    float discriminant = halfB * halfB - a * c;
+    if (discriminant < 0.0f)
+    {
+        return false;
+    }
+
+    // Smallest root first; fall back to the far root when the origin is inside
+    float sqrtDiscriminant = sqrtf(discriminant);
+    float t = (-halfB - sqrtDiscriminant) / a;
+    if (t < tMin || t > tMax)
+    {
+        t = (-halfB + sqrtDiscriminant) / a;
+        if (t < tMin || t > tMax)
+        {
+            return false;
+        }
+    }
+
+    hit.t = t;
+    hit.sphere = &sphere;
+    return true;
+}
+
+// Any-hit test for shadow rays: true as soon as any part of the sphere lies
+// within [tMin, tMax]. No root ordering and no hit record. With
+// cullBehindOrigin set, spheres entirely behind an outside origin are
+// rejected before the square root.
+inline bool IntersectAny(const Ray& ray, const Sphere& sphere, float tMin, float tMax, bool cullBehindOrigin)
+{
+    Vector3 rayOriginToSphereCenter = ray.origin - sphere.center;
+    float halfB = ray.direction.Dot(rayOriginToSphereCenter);
+    float c = rayOriginToSphereCenter.Dot(rayOriginToSphereCenter) - sphere.radius * sphere.radius;
+    if (cullBehindOrigin && c > 0.0f && halfB > 0.0f)
+    {
+        return false;
+    }
+
+    float a = ray.direction.Dot(ray.direction);
+    float discriminant = halfB * halfB - a * c;
+    if (discriminant < 0.0f)
+    {
+        return false;
+    }
+
+    float sqrtDiscriminant = sqrtf(discriminant);
+    float tNear = (-halfB - sqrtDiscriminant) / a;
+    float tFar = (-halfB + sqrtDiscriminant) / a;
+    return tNear <= tMax && tFar >= tMin;
+}
+
+inline Vector3 HitPoint(const Ray& ray, const HitRecord& hit)
+{
+    return ray.origin + ray.direction * hit.t;
+}
+
+inline void ComputeNormal(const Ray& ray, HitRecord& hit)
+{
+    hit.normal = (HitPoint(ray, hit) - hit.sphere->center) * (1.0f / hit.sphere->radius);
+}
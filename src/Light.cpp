@@ -0,0 +1,132 @@
+// Light.cpp
+
+#include "Light.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+float Axis(const Vector3& v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Fills in nodes[nodeIndex] for indices [first, first + count), splitting
+// at the median of the widest axis of the light positions
+void Subdivide(LightTree& tree, const Buffer<Light>& lights, std::vector<uint32_t>& indices, uint32_t nodeIndex, uint32_t first, uint32_t count)
+{
+    LightTreeNode node;
+    node.power = 0.0f;
+    Aabb centers;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        node.bounds.Grow(LightBounds(lights[indices[i]]));
+        node.power += Luminance(lights[indices[i]].intensity);
+        centers.Grow(lights[indices[i]].position);
+    }
+
+    if (count == 1)
+    {
+        node.leftFirst = indices[first];
+        node.count = 1;
+        tree.nodes[nodeIndex] = node;
+        return;
+    }
+
+    Vector3 extent = centers.max - centers.min;
+    int axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+    uint32_t half = count / 2;
+    std::nth_element(indices.begin() + first, indices.begin() + first + half, indices.begin() + first + count, [&](uint32_t lhs, uint32_t rhs)
+    {
+        return Axis(lights[lhs].position, axis) < Axis(lights[rhs].position, axis);
+    });
+
+    node.leftFirst = static_cast<uint32_t>(tree.nodes.size());
+    node.count = 0;
+    tree.nodes[nodeIndex] = node;
+    tree.nodes.emplace_back();
+    tree.nodes.emplace_back();
+
+    Subdivide(tree, lights, indices, node.leftFirst, first, half);
+    Subdivide(tree, lights, indices, node.leftFirst + 1, first + half, count - half);
+}
+
+// Rough upper estimate of what a node's lights deliver to the point: power
+// over squared distance to the box, or zero if the whole box lies below the
+// surface
+float Importance(const LightTreeNode& node, const Vector3& point, const Vector3& normal)
+{
+    Vector3 center = (node.bounds.min + node.bounds.max) * 0.5f;
+    Vector3 halfExtent = (node.bounds.max - node.bounds.min) * 0.5f;
+    Vector3 toCenter = center - point;
+
+    float maxAbove = normal.Dot(toCenter) + fabsf(normal.x) * halfExtent.x + fabsf(normal.y) * halfExtent.y + fabsf(normal.z) * halfExtent.z;
+    if (maxAbove <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // Clamped so points near or inside a cluster do not favour it unboundedly
+    float distanceSquared = Max(toCenter.Dot(toCenter), halfExtent.Dot(halfExtent));
+    return node.power / Max(distanceSquared, 1e-4f);
+}
+
+} // namespace
+
+void LightTree::Build(const Buffer<Light>& lights)
+{
+    nodes.clear();
+    if (lights.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> indices(lights.size());
+    for (uint32_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = i;
+    }
+    nodes.reserve(2 * lights.size() - 1);
+    nodes.emplace_back();
+    Subdivide(*this, lights, indices, 0, 0, static_cast<uint32_t>(lights.size()));
+}
+
+int LightTree::Sample(const Vector3& point, const Vector3& normal, float u, float& pdf) const
+{
+    pdf = 1.0f;
+    if (nodes.empty())
+    {
+        return -1;
+    }
+
+    const LightTreeNode* node = &nodes[0];
+    while (!node->IsLeaf())
+    {
+        const LightTreeNode& left = nodes[node->leftFirst];
+        const LightTreeNode& right = nodes[node->leftFirst + 1];
+        float leftImportance = Importance(left, point, normal);
+        float rightImportance = Importance(right, point, normal);
+        float total = leftImportance + rightImportance;
+        if (total <= 0.0f)
+        {
+            return -1;
+        }
+
+        // Reuse u for the next level by rescaling it into the chosen range
+        float leftProbability = leftImportance / total;
+        if (u < leftProbability)
+        {
+            u = u / leftProbability;
+            pdf *= leftProbability;
+            node = &left;
+        }
+        else
+        {
+            u = Min((u - leftProbability) / (1.0f - leftProbability), 0.99999994f);
+            pdf *= 1.0f - leftProbability;
+            node = &right;
+        }
+    }
+    return static_cast<int>(node->leftFirst);
+}
@@ -0,0 +1,75 @@
+// Light.h
+
+#pragma once
+
+#include "Bvh.h"
+#include <cstdint>
+
+enum class LightType
+{
+    Point,
+    Spot,
+    Sphere,
+};
+
+// Local light. intensity is radiant intensity, so a point light delivers
+// intensity / distance^2. A sphere light of the same intensity matches it
+// from afar but casts soft shadows; spots fade from full intensity inside
+// cosInner to nothing outside cosOuter around direction.
+class Light
+{
+public:
+    LightType type;
+    Vector3   position;
+    Vector3   intensity;
+    Vector3   direction; // Spot axis, pointing away from the light
+    float     cosInner;
+    float     cosOuter;
+    float     radius;    // Sphere lights only
+};
+
+inline Aabb LightBounds(const Light& light)
+{
+    Aabb bounds;
+    float radius = light.type == LightType::Sphere ? light.radius : 0.0f;
+    bounds.min = light.position - Vector3(radius);
+    bounds.max = light.position + Vector3(radius);
+    return bounds;
+}
+
+// Interior nodes keep their left child in leftFirst (the right follows it);
+// leaves have count 1 and keep an index into the light list.
+class LightTreeNode
+{
+public:
+    bool IsLeaf() const
+    {
+        return count > 0;
+    }
+
+    Aabb     bounds;
+    float    power;     // Summed luminance of the lights below
+    uint32_t leftFirst;
+    uint32_t count;
+};
+
+// Binary hierarchy over the lights, used to pick one light per shadow ray
+// with probability close to its share of the lighting at a point. Sampling
+// walks a single root-to-leaf path, so its cost grows with log(lights).
+class LightTree
+{
+public:
+    void Build(const Buffer<Light>& lights);
+
+    // Picks a light for a surface point from a uniform u in [0, 1). Returns
+    // the light's index and its selection probability, or -1 if every light
+    // is below the surface.
+    int Sample(const Vector3& point, const Vector3& normal, float u, float& pdf) const;
+
+    bool Empty() const
+    {
+        return nodes.empty();
+    }
+
+    Buffer<LightTreeNode> nodes;
+};
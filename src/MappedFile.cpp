@@ -0,0 +1,105 @@
+// MappedFile.cpp
+
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+
+    // The view keeps the mapping alive on its own
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+    {
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+    {
+        UnmapViewOfFile(data);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    void* view = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    data = static_cast<uint8_t*>(view);
+    size = static_cast<size_t>(status.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data)
+    {
+        munmap(data, size);
+    }
+    data = nullptr;
+    size = 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// MappedFile.h
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Whole file mapped copy-on-write: pages load on first touch, and writes
+// through Data() stay private to the process and never reach the file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Replaces any current mapping. Fails on missing or empty files.
+    bool Open(const char* path);
+    void Close();
+
+    uint8_t* Data() const
+    {
+        return data;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+private:
+    uint8_t* data = nullptr;
+    size_t   size = 0;
+};
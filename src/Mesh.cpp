@@ -0,0 +1,462 @@
+// Mesh.cpp
+
+#include "Mesh.h"
+#include "BvhBuilder.h"
+#include "Simd.h"
+#include <algorithm>
+#include <chrono>
+
+using namespace Simd;
+
+namespace
+{
+
+const int kStackSize = 64;
+
+// Triangles copied per thread pool task
+const uint32_t kCopyChunkSize = 1 << 16;
+
+// Rays closer than this to the triangle's plane (scaled by its area) miss
+const float kDeterminantEpsilon = 1.0e-12f;
+
+// Bounds are computed once; the builder asks for them many times per triangle
+class TrianglePrimitives
+{
+public:
+    Aabb Bounds(uint32_t index) const
+    {
+        Aabb bounds;
+        for (uint32_t vertex : triangles[index].vertices)
+        {
+            bounds.Grow(vertices[vertex]);
+        }
+        return bounds;
+    }
+
+    const Buffer<Vector3>&  vertices;
+    const Buffer<Triangle>& triangles;
+};
+
+#if !defined(SOFTRT_SIMD)
+
+// Moller-Trumbore; same operations as the wide kernels
+bool IntersectTriangle(const TriangleSoA& triangles, uint32_t i, const Ray& ray, float tMin, float tMax, float& t, float& u, float& v)
+{
+    Vector3 edge1{ triangles.edge1X[i], triangles.edge1Y[i], triangles.edge1Z[i] };
+    Vector3 edge2{ triangles.edge2X[i], triangles.edge2Y[i], triangles.edge2Z[i] };
+    Vector3 p = ray.direction.Cross(edge2);
+    float determinant = edge1.Dot(p);
+    if (Max(determinant, -determinant) <= kDeterminantEpsilon)
+    {
+        return false;
+    }
+
+    float inverseDeterminant = 1.0f / determinant;
+    Vector3 s = ray.origin - Vector3{ triangles.v0X[i], triangles.v0Y[i], triangles.v0Z[i] };
+    u = s.Dot(p) * inverseDeterminant;
+    Vector3 q = s.Cross(edge1);
+    v = ray.direction.Dot(q) * inverseDeterminant;
+    t = edge2.Dot(q) * inverseDeterminant;
+    return u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= tMin && t <= tMax;
+}
+
+#endif
+
+} // namespace
+
+void TriangleSoA::Build(const Buffer<Vector3>& vertices, const Buffer<Triangle>& triangles, const Buffer<uint32_t>* order, int threadCount)
+{
+    count = static_cast<uint32_t>(triangles.size());
+    size_t paddedCount = count + kWidth;
+    Buffer<float>* arrays[] = { &v0X, &v0Y, &v0Z, &edge1X, &edge1Y, &edge1Z, &edge2X, &edge2Y, &edge2Z };
+    for (Buffer<float>* array : arrays)
+    {
+        array->assign(paddedCount, 0.0f);
+    }
+
+    uint32_t chunkCount = (count + kCopyChunkSize - 1) / kCopyChunkSize;
+    SharedThreadPool(threadCount).ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kCopyChunkSize;
+        uint32_t last = std::min(first + kCopyChunkSize, count);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            const Triangle& triangle = triangles[order ? (*order)[i] : i];
+            const Vector3& v0 = vertices[triangle.vertices[0]];
+            Vector3 edge1 = vertices[triangle.vertices[1]] - v0;
+            Vector3 edge2 = vertices[triangle.vertices[2]] - v0;
+            v0X[i] = v0.x;
+            v0Y[i] = v0.y;
+            v0Z[i] = v0.z;
+            edge1X[i] = edge1.x;
+            edge1Y[i] = edge1.y;
+            edge1Z[i] = edge1.z;
+            edge2X[i] = edge2.x;
+            edge2Y[i] = edge2.y;
+            edge2Z[i] = edge2.z;
+        }
+    });
+}
+
+size_t TriangleSoA::MemoryBytes() const
+{
+    return (v0X.size() + v0Y.size() + v0Z.size() + edge1X.size() + edge1Y.size() + edge1Z.size() +
+        edge2X.size() + edge2Y.size() + edge2Z.size()) * sizeof(float);
+}
+
+#if defined(SOFTRT_SIMD)
+
+namespace
+{
+
+// Moller-Trumbore on one register of triangles: hit distance and
+// barycentrics per lane, and the mask of lanes hit within [tMin, tMax]
+class TriangleLanes
+{
+public:
+    Lanes t;
+    Lanes u;
+    Lanes v;
+    int   mask;
+};
+
+class RayLanes
+{
+public:
+    explicit RayLanes(const Ray& ray)
+        : originX(Set1(ray.origin.x))
+        , originY(Set1(ray.origin.y))
+        , originZ(Set1(ray.origin.z))
+        , directionX(Set1(ray.direction.x))
+        , directionY(Set1(ray.direction.y))
+        , directionZ(Set1(ray.direction.z))
+    {}
+
+    Lanes originX;
+    Lanes originY;
+    Lanes originZ;
+    Lanes directionX;
+    Lanes directionY;
+    Lanes directionZ;
+};
+
+inline TriangleLanes IntersectLanes(const TriangleSoA& triangles, uint32_t base, uint32_t remaining, const RayLanes& ray, Lanes minT, Lanes maxT)
+{
+    const Lanes zero = Set1(0.0f);
+    const Lanes one = Set1(1.0f);
+    Lanes edge1X = Load(&triangles.edge1X[base]);
+    Lanes edge1Y = Load(&triangles.edge1Y[base]);
+    Lanes edge1Z = Load(&triangles.edge1Z[base]);
+    Lanes edge2X = Load(&triangles.edge2X[base]);
+    Lanes edge2Y = Load(&triangles.edge2Y[base]);
+    Lanes edge2Z = Load(&triangles.edge2Z[base]);
+
+    // p = direction x edge2; determinant = edge1 . p
+    Lanes pX = Sub(Mul(ray.directionY, edge2Z), Mul(ray.directionZ, edge2Y));
+    Lanes pY = Sub(Mul(ray.directionZ, edge2X), Mul(ray.directionX, edge2Z));
+    Lanes pZ = Sub(Mul(ray.directionX, edge2Y), Mul(ray.directionY, edge2X));
+    Lanes determinant = Add(Add(Mul(edge1X, pX), Mul(edge1Y, pY)), Mul(edge1Z, pZ));
+    Lanes inverseDeterminant = Div(one, determinant);
+
+    // s = origin - v0; q = s x edge1
+    Lanes sX = Sub(ray.originX, Load(&triangles.v0X[base]));
+    Lanes sY = Sub(ray.originY, Load(&triangles.v0Y[base]));
+    Lanes sZ = Sub(ray.originZ, Load(&triangles.v0Z[base]));
+    Lanes qX = Sub(Mul(sY, edge1Z), Mul(sZ, edge1Y));
+    Lanes qY = Sub(Mul(sZ, edge1X), Mul(sX, edge1Z));
+    Lanes qZ = Sub(Mul(sX, edge1Y), Mul(sY, edge1X));
+
+    TriangleLanes result;
+    result.u = Mul(Add(Add(Mul(sX, pX), Mul(sY, pY)), Mul(sZ, pZ)), inverseDeterminant);
+    result.v = Mul(Add(Add(Mul(ray.directionX, qX), Mul(ray.directionY, qY)), Mul(ray.directionZ, qZ)), inverseDeterminant);
+    result.t = Mul(Add(Add(Mul(edge2X, qX), Mul(edge2Y, qY)), Mul(edge2Z, qZ)), inverseDeterminant);
+
+    Lanes valid = CmpGt(MaxLanes(determinant, Sub(zero, determinant)), Set1(kDeterminantEpsilon));
+    valid = And(valid, And(CmpGe(result.u, zero), CmpGe(result.v, zero)));
+    valid = And(valid, CmpLe(Add(result.u, result.v), one));
+    valid = And(valid, And(CmpGe(result.t, minT), CmpLe(result.t, maxT)));
+    result.mask = MoveMask(valid);
+    if (remaining < kLanes)
+    {
+        result.mask &= (1 << remaining) - 1;
+    }
+    return result;
+}
+
+} // namespace
+
+int IntersectNearestTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax, float& u, float& v)
+{
+    const RayLanes rayLanes(ray);
+    const Lanes minT = Set1(tMin);
+
+    int nearest = -1;
+    for (uint32_t i = 0; i < count; i += kLanes)
+    {
+        uint32_t base = first + i;
+        TriangleLanes lanes = IntersectLanes(triangles, base, count - i, rayLanes, minT, Set1(tMax));
+        if (lanes.mask == 0)
+        {
+            continue;
+        }
+
+        float laneT[kLanes];
+        float laneU[kLanes];
+        float laneV[kLanes];
+        Store(laneT, lanes.t);
+        Store(laneU, lanes.u);
+        Store(laneV, lanes.v);
+        for (uint32_t lane = 0; lane < kLanes; ++lane)
+        {
+            if ((lanes.mask & (1 << lane)) && laneT[lane] <= tMax)
+            {
+                tMax = laneT[lane];
+                u = laneU[lane];
+                v = laneV[lane];
+                nearest = static_cast<int>(base + lane);
+            }
+        }
+    }
+    return nearest;
+}
+
+bool IntersectAnyTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax)
+{
+    const RayLanes rayLanes(ray);
+    const Lanes minT = Set1(tMin);
+    const Lanes maxT = Set1(tMax);
+    for (uint32_t i = 0; i < count; i += kLanes)
+    {
+        if (IntersectLanes(triangles, first + i, count - i, rayLanes, minT, maxT).mask != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#else
+
+int IntersectNearestTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax, float& u, float& v)
+{
+    int nearest = -1;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        float t;
+        float hitU;
+        float hitV;
+        if (IntersectTriangle(triangles, i, ray, tMin, tMax, t, hitU, hitV))
+        {
+            tMax = t;
+            u = hitU;
+            v = hitV;
+            nearest = static_cast<int>(i);
+        }
+    }
+    return nearest;
+}
+
+bool IntersectAnyTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax)
+{
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        float t;
+        float u;
+        float v;
+        if (IntersectTriangle(triangles, i, ray, tMin, tMax, t, u, v))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
+
+void TriangleBvh::Build(const Buffer<Vector3>& inVertices, const Buffer<Vector3>& inNormals, const Buffer<Triangle>& inTriangles, int threadCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    vertices = &inVertices;
+    normals = &inNormals;
+    triangles = &inTriangles;
+    stats = BvhStats();
+
+    BuildBvhNodes(TrianglePrimitives{ inVertices, inTriangles }, static_cast<uint32_t>(inTriangles.size()), threadCount, nodes, primitiveIndices, stats);
+
+    auto phaseStart = std::chrono::steady_clock::now();
+    leafTriangles.Build(inVertices, inTriangles, &primitiveIndices, threadCount);
+    stats.phases.leavesMs = BvhBuild::MillisecondsSince(phaseStart);
+
+    stats.memoryBytes = MemoryBytes();
+    stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TriangleBvh::Clear()
+{
+    nodes.clear();
+    primitiveIndices.clear();
+    leafTriangles.count = 0;
+    Buffer<float>* leafArrays[] = { &leafTriangles.v0X, &leafTriangles.v0Y, &leafTriangles.v0Z,
+        &leafTriangles.edge1X, &leafTriangles.edge1Y, &leafTriangles.edge1Z, &leafTriangles.edge2X, &leafTriangles.edge2Y, &leafTriangles.edge2Z };
+    for (Buffer<float>* array : leafArrays)
+    {
+        array->clear();
+    }
+    vertices = nullptr;
+    normals = nullptr;
+    triangles = nullptr;
+    stats = BvhStats();
+}
+
+size_t TriangleBvh::MemoryBytes() const
+{
+    return nodes.size() * sizeof(BvhNode) + primitiveIndices.size() * sizeof(uint32_t) + leafTriangles.MemoryBytes();
+}
+
+bool TriangleBvh::ClosestHit(const Ray& ray, float tMin, float tMax, HitRecord& hit) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+    int nearest = -1;
+    float u = 0.0f;
+    float v = 0.0f;
+
+    uint32_t stack[kStackSize];
+    float stackEntry[kStackSize];
+    int stackSize = 0;
+    stack[stackSize] = 0;
+    stackEntry[stackSize++] = IntersectAabb(ray.origin, inverseDirection, nodes[0].bounds, tMin, tMax);
+    while (stackSize > 0)
+    {
+        --stackSize;
+        if (stackEntry[stackSize] > tMax)
+        {
+            continue;
+        }
+
+        const BvhNode& node = nodes[stack[stackSize]];
+        if (node.IsLeaf())
+        {
+            int index = IntersectNearestTriangles(leafTriangles, node.leftFirst, node.count, ray, tMin, tMax, u, v);
+            nearest = index >= 0 ? index : nearest;
+            continue;
+        }
+
+        uint32_t nearIndex = node.leftFirst;
+        uint32_t farIndex = node.leftFirst + 1;
+        float nearEntry = IntersectAabb(ray.origin, inverseDirection, nodes[nearIndex].bounds, tMin, tMax);
+        float farEntry = IntersectAabb(ray.origin, inverseDirection, nodes[farIndex].bounds, tMin, tMax);
+        if (farEntry < nearEntry)
+        {
+            std::swap(nearIndex, farIndex);
+            std::swap(nearEntry, farEntry);
+        }
+        if (farEntry != FLT_MAX)
+        {
+            stack[stackSize] = farIndex;
+            stackEntry[stackSize++] = farEntry;
+        }
+        if (nearEntry != FLT_MAX)
+        {
+            stack[stackSize] = nearIndex;
+            stackEntry[stackSize++] = nearEntry;
+        }
+    }
+
+    if (nearest < 0)
+    {
+        return false;
+    }
+
+    hit.t = tMax;
+    hit.sphere = nullptr;
+    hit.triangle = primitiveIndices[nearest];
+
+    // Interpolated vertex normal, or the face normal where there is none
+    const Triangle& triangle = (*triangles)[hit.triangle];
+    Vector3 normal(0.0f);
+    if (!normals->empty())
+    {
+        normal = (*normals)[triangle.vertices[0]] * (1.0f - u - v) + (*normals)[triangle.vertices[1]] * u + (*normals)[triangle.vertices[2]] * v;
+    }
+    if (normal.Dot(normal) == 0.0f)
+    {
+        Vector3 edge1{ leafTriangles.edge1X[nearest], leafTriangles.edge1Y[nearest], leafTriangles.edge1Z[nearest] };
+        Vector3 edge2{ leafTriangles.edge2X[nearest], leafTriangles.edge2Y[nearest], leafTriangles.edge2Z[nearest] };
+        normal = edge1.Cross(edge2);
+    }
+    normal = normal.Normalize();
+    hit.normal = normal.Dot(ray.direction) > 0.0f ? normal * -1.0f : normal;
+    return true;
+}
+
+bool TriangleBvh::AnyHit(const Ray& ray, float tMin, float tMax) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    Vector3 inverseDirection{ 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+
+    uint32_t stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode& node = nodes[stack[--stackSize]];
+        if (IntersectAabb(ray.origin, inverseDirection, node.bounds, tMin, tMax) == FLT_MAX)
+        {
+            continue;
+        }
+
+        if (node.IsLeaf())
+        {
+            if (IntersectAnyTriangles(leafTriangles, node.leftFirst, node.count, ray, tMin, tMax))
+            {
+                return true;
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+    }
+    return false;
+}
+
+void AppendTorus(Buffer<Vector3>& vertices, Buffer<Vector3>& normals, Buffer<Triangle>& triangles, const Vector3& center, float majorRadius, float minorRadius, int rings, int sides)
+{
+    uint32_t base = static_cast<uint32_t>(vertices.size());
+    normals.resize(base, Vector3(0.0f));
+    for (int ring = 0; ring < rings; ++ring)
+    {
+        float theta = 2.0f * kPi * static_cast<float>(ring) / static_cast<float>(rings);
+        Vector3 radial{ cosf(theta), 0.0f, sinf(theta) };
+        for (int side = 0; side < sides; ++side)
+        {
+            float phi = 2.0f * kPi * static_cast<float>(side) / static_cast<float>(sides);
+            Vector3 normal = radial * cosf(phi) + Vector3{ 0.0f, sinf(phi), 0.0f };
+            vertices.push_back(center + radial * majorRadius + normal * minorRadius);
+            normals.push_back(normal);
+        }
+    }
+
+    for (int ring = 0; ring < rings; ++ring)
+    {
+        uint32_t row = base + static_cast<uint32_t>(ring * sides);
+        uint32_t nextRow = base + static_cast<uint32_t>(((ring + 1) % rings) * sides);
+        for (int side = 0; side < sides; ++side)
+        {
+            uint32_t column = static_cast<uint32_t>(side);
+            uint32_t nextColumn = static_cast<uint32_t>((side + 1) % sides);
+            triangles.push_back(Triangle{ { row + column, row + nextColumn, nextRow + nextColumn } });
+            triangles.push_back(Triangle{ { row + column, nextRow + nextColumn, nextRow + column } });
+        }
+    }
+}
@@ -0,0 +1,80 @@
+// Mesh.h
+
+#pragma once
+
+#include "Bvh.h"
+#include <cstdint>
+
+// Indexed triangle; the vertices index shared position and normal arrays
+class Triangle
+{
+public:
+    uint32_t vertices[3];
+};
+
+// Structure-of-arrays copy of a triangle list for the wide Moller-Trumbore
+// kernels: the first vertex and the two edges leaving it. Padded like
+// SphereSoA; padded lanes are degenerate and never hit.
+class TriangleSoA
+{
+public:
+    static const uint32_t kWidth = SphereSoA::kWidth;
+
+    // Copies triangles in the given order (identity when order is null)
+    void Build(const Buffer<Vector3>& vertices, const Buffer<Triangle>& triangles, const Buffer<uint32_t>* order = nullptr, int threadCount = 0);
+
+    size_t MemoryBytes() const;
+
+    uint32_t      count = 0;
+    Buffer<float> v0X;
+    Buffer<float> v0Y;
+    Buffer<float> v0Z;
+    Buffer<float> edge1X;
+    Buffer<float> edge1Y;
+    Buffer<float> edge1Z;
+    Buffer<float> edge2X;
+    Buffer<float> edge2Y;
+    Buffer<float> edge2Z;
+};
+
+// Nearest triangle in [first, first + count) hit within [tMin, tMax].
+// Returns its index, narrows tMax to its distance and sets the barycentric
+// coordinates of the hit along edge1 (u) and edge2 (v), or returns -1.
+// Triangles are two-sided.
+int IntersectNearestTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax, float& u, float& v);
+
+// True if any triangle in [first, first + count) is hit within [tMin, tMax]
+bool IntersectAnyTriangles(const TriangleSoA& triangles, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax);
+
+// Hierarchy over an indexed triangle mesh, built with the same SAH builder
+// as Bvh and traversed the same way. The vertex, normal and triangle arrays
+// must outlive it. normals is either empty or parallel to vertices; a zero
+// normal means the vertex has none and its triangles shade flat.
+class TriangleBvh
+{
+public:
+    // threadCount <= 0 uses every hardware thread
+    void Build(const Buffer<Vector3>& inVertices, const Buffer<Vector3>& inNormals, const Buffer<Triangle>& inTriangles, int threadCount = 0);
+
+    // Drops the hierarchy and its stats without touching the thread pool
+    void Clear();
+
+    // Nodes, indices and leaf triangles, whether owned or mapped
+    size_t MemoryBytes() const;
+
+    // Fills t, triangle and a unit normal facing against the ray; sphere is null
+    bool ClosestHit(const Ray& ray, float tMin, float tMax, HitRecord& hit) const;
+    bool AnyHit(const Ray& ray, float tMin, float tMax) const;
+
+    Buffer<BvhNode>         nodes;
+    Buffer<uint32_t>        primitiveIndices;
+    TriangleSoA             leafTriangles;
+    const Buffer<Vector3>*  vertices = nullptr;
+    const Buffer<Vector3>*  normals = nullptr;
+    const Buffer<Triangle>* triangles = nullptr;
+    BvhStats                stats;
+};
+
+// Appends a torus around the y axis to a mesh, with rings segments around
+// the axis and sides segments around the tube, and smooth normals
+void AppendTorus(Buffer<Vector3>& vertices, Buffer<Vector3>& normals, Buffer<Triangle>& triangles, const Vector3& center, float majorRadius, float minorRadius, int rings, int sides);
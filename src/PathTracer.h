@@ -0,0 +1,314 @@
+// PathTracer.h
+//
+// Pieces shared by the per-pixel and wavefront integrators. Both must do
+// the same float math in the same order so they produce identical images.
+
+#pragma once
+
+#include "Framebuffer.h"
+#include "Intersect.h"
+#include "Random.h"
+#include "Renderer.h"
+#include "Sampling.h"
+#include <algorithm>
+#include <cstdint>
+
+// Rays traced by the calling thread; see ThreadRayCount()
+extern thread_local uint64_t threadRayCount;
+
+const Vector3 LightDir = Vector3{ 1.0f, 1.0f, -1.0f }.Normalize();
+const Vector3 SkyCol = Vector3{ 0.75f, 0.75f, 1.0f };
+const float kSpecularExponent = 128.0f;
+
+// Cap on next-event estimates per vertex; see RenderSettings::lightSamples
+const int kMaxLightSamples = 4;
+
+// Local lighting at a path vertex, computed before its shadow ray is traced
+class SurfaceSample
+{
+public:
+    Vector3 origin; // Offset off the surface; starts the shadow and bounce rays
+    Vector3 normal;
+    Vector3 outgoing; // Unit vector back along the ray that hit the surface
+    Vector3 color;
+    float   roughness;
+    float   diffuse;
+    float   specular;
+};
+
+inline SurfaceSample SampleSurface(const Scene& scene, const Ray& ray, const HitRecord& hit, const Vector3& cameraPosition)
+{
+    SurfaceSample surface;
+    Vector3 intersection = HitPoint(ray, hit);
+    surface.normal = hit.normal;
+    surface.outgoing = (ray.direction * -1.0f).Normalize();
+    const Material& material = scene.MaterialOf(hit);
+    surface.color = material.color;
+    surface.roughness = material.roughness;
+    Vector3 eye = (intersection - cameraPosition).Normalize();
+
+    float diffuse = surface.normal.Dot(LightDir);
+    surface.diffuse = diffuse >= 0.0f ? diffuse : 0.0f;
+
+    Vector3 half = ((eye * -1.0f) + LightDir).Normalize();
+    float specular = surface.normal.Dot(half);
+    specular = specular < 0.0f ? 0.0f : specular;
+
+    surface.specular = powf(specular, kSpecularExponent);
+
+    surface.origin = intersection + surface.normal * 0.001f;
+    return surface;
+}
+
+// Share of a vertex's reflection that is diffuse rather than bounced; the
+// last vertex a path may reach is fully diffuse
+inline float DiffuseWeight(const SurfaceSample& surface, int bounce, int maxBounces)
+{
+    return bounce < maxBounces ? surface.roughness : 1.0f;
+}
+
+// Adds the light the vertex reflects toward the previous one to radiance,
+// scaled by throughput, then scales throughput by how much of the bounce
+// result reaches the camera. Returns false when the path ends here.
+inline bool FinishSurface(const SurfaceSample& surface, bool occluded, int bounce, int maxBounces, Vector3& throughput, Vector3& radiance)
+{
+    float diffuse = occluded ? 0.0f : surface.diffuse;
+    float specular = occluded ? 0.0f : surface.specular;
+
+    const float ambient = 0.15f;
+    Vector3 diffuseColor = surface.color * Max(diffuse, ambient);
+
+    // Lerp(surface, white, specular) with the bounce folded into surface
+    // as roughness * diffuse + (1 - roughness) * bounce
+    float reflectance = DiffuseWeight(surface, bounce, maxBounces);
+    radiance = radiance + throughput * (diffuseColor * (reflectance * (1.0f - specular)) + Vector3(specular));
+    throughput = throughput * ((1.0f - reflectance) * (1.0f - specular));
+
+    // Fully rough or fully specular vertices end the path without tracing
+    // a bounce that would contribute nothing
+    return throughput.x > 0.0f || throughput.y > 0.0f || throughput.z > 0.0f;
+}
+
+inline int LightSampleCount(const Scene& scene, const RenderSettings& settings)
+{
+    return scene.lightTree.Empty() ? 0 : std::min(std::max(settings.lightSamples, 0), kMaxLightSamples);
+}
+
+// Next-event estimate toward one local light, before its shadow ray is
+// traced. contribution is what reaches the camera per unit throughput if
+// nothing blocks direction within distance.
+class LightSample
+{
+public:
+    Vector3 direction;
+    float   distance;
+    Vector3 contribution;
+};
+
+// Picks one of sampleCount lights for a vertex from the light tree and
+// weights it by 1 / (selection pdf * sampleCount). Returns false if no light
+// can reach the vertex.
+inline bool SampleLocalLight(const Scene& scene, const SurfaceSample& surface, float diffuseWeight, int sampleCount, Random& random, LightSample& sample)
+{
+    float selectionPdf;
+    int lightIndex = scene.lightTree.Sample(surface.origin, surface.normal, random.NextFloat(), selectionPdf);
+    if (lightIndex < 0)
+    {
+        return false;
+    }
+    const Light& light = scene.lights[lightIndex];
+
+    Vector3 toLight = light.position - surface.origin;
+    float distanceSquared = toLight.Dot(toLight);
+    Vector3 incident;
+    if (light.type == LightType::Sphere)
+    {
+        float radiusSquared = light.radius * light.radius;
+        if (distanceSquared <= radiusSquared)
+        {
+            return false;
+        }
+
+        // Uniform direction in the cone the sphere subtends. The sphere has
+        // radiance intensity / (pi r^2) and the cone 2 pi (1 - cosThetaMax)
+        // of solid angle.
+        float distance = sqrtf(distanceSquared);
+        float cosThetaMax = sqrtf(1.0f - radiusSquared / distanceSquared);
+        float cosTheta = 1.0f - random.NextFloat() * (1.0f - cosThetaMax);
+        float sinTheta = sqrtf(Max(1.0f - cosTheta * cosTheta, 0.0f));
+        float phi = 2.0f * kPi * random.NextFloat();
+        sample.direction = FromBasis(toLight * (1.0f / distance), sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+        sample.distance = distance * cosTheta - sqrtf(Max(radiusSquared - distanceSquared * sinTheta * sinTheta, 0.0f));
+        incident = light.intensity * (2.0f * (1.0f - cosThetaMax) / radiusSquared);
+    }
+    else
+    {
+        sample.distance = sqrtf(distanceSquared);
+        sample.direction = toLight * (1.0f / sample.distance);
+        incident = light.intensity * (1.0f / distanceSquared);
+        if (light.type == LightType::Spot)
+        {
+            float cosAngle = -sample.direction.Dot(light.direction);
+            float t = Saturate((cosAngle - light.cosOuter) / (light.cosInner - light.cosOuter));
+            incident = incident * (t * t * (3.0f - 2.0f * t));
+        }
+    }
+
+    float cosTheta = surface.normal.Dot(sample.direction);
+    if (cosTheta <= 0.0f)
+    {
+        return false;
+    }
+
+    Vector3 half = surface.outgoing + sample.direction;
+    float halfLength = half.Length();
+    float specular = halfLength > 0.0f ? powf(Max(surface.normal.Dot(half) / halfLength, 0.0f), kSpecularExponent) : 0.0f;
+
+    sample.contribution = (surface.color * (diffuseWeight * cosTheta) + Vector3(specular)) * incident * (1.0f / (selectionPdf * static_cast<float>(sampleCount)));
+    return true;
+}
+
+// Picks the bounce ray leaving a vertex whose path goes on. By default it
+// follows the normal. With settings.sampleBounces it is importance sampled
+// from a mix of a cosine-weighted diffuse lobe, chosen with probability
+// roughness, and a GGX lobe with alpha = roughness^2. The throughput is then
+// weighted by f cos / pdf of the mixture. Returns false if the sample
+// carries no energy.
+inline bool SampleBounce(const SurfaceSample& surface, const RenderSettings& settings, Random& random, Vector3& throughput, Ray& bounce)
+{
+    bounce.origin = surface.origin;
+    if (!settings.sampleBounces)
+    {
+        bounce.direction = surface.normal;
+        return true;
+    }
+
+    float diffuseWeight = surface.roughness;
+    float alpha = Max(surface.roughness * surface.roughness, 0.001f);
+    float u1 = random.NextFloat();
+    float u2 = random.NextFloat();
+    DirectionSample sample = random.NextFloat() < diffuseWeight ?
+        SampleCosineHemisphere(surface.normal, u1, u2) :
+        SampleGgxReflection(surface.normal, surface.outgoing, alpha, u1, u2);
+    if (sample.pdf <= 0.0f)
+    {
+        return false;
+    }
+
+    float pdf = diffuseWeight * CosineHemispherePdf(surface.normal, sample.direction) +
+        (1.0f - diffuseWeight) * GgxReflectionPdf(surface.normal, surface.outgoing, sample.direction, alpha);
+    float reflectance = diffuseWeight * CosineHemispherePdf(surface.normal, sample.direction) +
+        (1.0f - diffuseWeight) * GgxReflectance(surface.normal, surface.outgoing, sample.direction, alpha);
+    if (pdf <= 0.0f || reflectance <= 0.0f)
+    {
+        return false;
+    }
+
+    bounce.direction = sample.direction;
+    throughput = throughput * (reflectance / pdf);
+    return true;
+}
+
+// Lower bound on the survival probability, which caps the 1 / p weight of
+// a surviving path and with it the brightness of rare fireflies
+const float kMinSurvival = 0.05f;
+
+// Russian roulette on the bounce about to be traced from vertex bounce.
+// From settings.rouletteMinBounces on, a path survives with probability p
+// equal to its largest throughput component and survivors are weighted by
+// 1 / p, so the estimate stays unbiased. Returns false to end the path.
+inline bool SurviveRoulette(const RenderSettings& settings, int bounce, Random& random, Vector3& throughput)
+{
+    if (settings.rouletteMinBounces < 0 || bounce < settings.rouletteMinBounces)
+    {
+        return true;
+    }
+
+    float survival = Max(Max(throughput.x, throughput.y), Max(throughput.z, kMinSurvival));
+    if (survival >= 1.0f)
+    {
+        return true;
+    }
+    if (random.NextFloat() >= survival)
+    {
+        return false;
+    }
+
+    throughput = throughput * (1.0f / survival);
+    return true;
+}
+
+// Each pixel and pass gets its own generator, so the image does not depend
+// on which thread renders the pixel
+inline Random PixelRandom(int i, int j, uint32_t sampleIndex)
+{
+    return Random((static_cast<uint64_t>(j) << 32) | static_cast<uint32_t>(i), sampleIndex);
+}
+
+// Sub-pixel sample position for a pass, in pixels. Pass 0 samples the pixel
+// corner as single-shot rendering always has.
+inline void PixelSampleOffset(uint32_t sampleIndex, Random& random, float& offsetX, float& offsetY)
+{
+    if (sampleIndex == 0)
+    {
+        offsetX = 0.0f;
+        offsetY = 0.0f;
+        return;
+    }
+
+    offsetX = random.NextFloat();
+    offsetY = random.NextFloat();
+}
+
+// The camera looks down +z through a window spanning [-1, 1] in x and y
+// this far ahead of it; moving it translates the whole view
+const float kWindowDistance = 2.0f;
+
+// Camera ray direction through a point of pixel (i, j) of the window
+inline Vector3 CameraRayDirection(const Framebuffer& framebuffer, int i, int j, float offsetX, float offsetY)
+{
+    float dx = 2.0f / static_cast<float>(framebuffer.width);
+    float dy = 2.0f / static_cast<float>(framebuffer.height);
+
+    Vector3 windowPos;
+    windowPos.x = -1.0f + dx * (static_cast<float>(i) + offsetX);
+    windowPos.y = 1.0f - dy * (static_cast<float>(j) + offsetY);
+    windowPos.z = kWindowDistance;
+    return windowPos;
+}
+
+// Depth recorded for camera rays that escape to the sky
+const float kSkyDepth = 1.0e4f;
+
+// Records the denoiser guide features of a camera ray's first hit (or of
+// the sky if hit is null), if the accumulation tracks them
+inline void RecordFeatures(AccumulationBuffer& accumulation, const Scene& scene, int i, int j, const Ray& ray, const HitRecord* hit)
+{
+    if (!accumulation.HasFeatures())
+    {
+        return;
+    }
+
+    if (hit)
+    {
+        accumulation.AccumulateFeatures(i, j, scene.MaterialOf(*hit).color, hit->normal, hit->t * ray.direction.Length());
+    }
+    else
+    {
+        accumulation.AccumulateFeatures(i, j, SkyCol, Vector3(0.0f), kSkyDepth);
+    }
+}
+
+// Adaptive sampling: false once the pixel has converged and should get no
+// more samples. Also false for pixels whose history was just reprojected.
+inline bool PixelActive(const AccumulationBuffer& accumulation, const RenderSettings& settings, int i, int j)
+{
+    if (accumulation.Reused(i, j))
+    {
+        return false;
+    }
+    return settings.noiseThreshold <= 0.0f || !accumulation.Converged(i, j, settings.noiseThreshold, static_cast<uint32_t>(settings.minSamples));
+}
+
+// Wavefront variant of RenderPass; see RenderSettings::useWavefront
+uint64_t RenderPassWavefront(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings, const Vector3& camPos);
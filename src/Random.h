@@ -0,0 +1,67 @@
+// Random.h
+
+#pragma once
+
+#include <cstdint>
+
+// PCG32 (XSH-RR) generator. Sixteen bytes, the state and the stream's odd
+// increment, and no shared hidden state, so every thread, tile or pixel can
+// own one; the stream selects one of 2^63 independent sequences for the
+// same seed.
+class Random
+{
+public:
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bull, uint64_t stream = 0xda3e39cb94b95bdbull)
+        : state(0)
+        , increment((stream << 1) | 1)
+    {
+        NextUint();
+        state += seed;
+        NextUint();
+    }
+
+    uint32_t NextUint()
+    {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ull + increment;
+        uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18) ^ oldState) >> 27);
+        uint32_t rotation = static_cast<uint32_t>(oldState >> 59);
+        return (xorShifted >> rotation) | (xorShifted << ((0u - rotation) & 31));
+    }
+
+    // Uniform in [0, 1) with the full 24-bit float mantissa
+    float NextFloat()
+    {
+        return static_cast<float>(NextUint() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Uniform in [-1, 1)
+    float NextFloatSigned()
+    {
+        return NextFloat() * 2.0f - 1.0f;
+    }
+
+    // Skips delta draws in O(log delta) (Brown, "Random Number Generation
+    // with Arbitrary Strides"), so a sequence can be split across threads
+    void Advance(uint64_t delta)
+    {
+        uint64_t multiplier = 6364136223846793005ull;
+        uint64_t addend = increment;
+        uint64_t totalMultiplier = 1;
+        uint64_t totalAddend = 0;
+        for (; delta > 0; delta >>= 1)
+        {
+            if (delta & 1)
+            {
+                totalMultiplier *= multiplier;
+                totalAddend = totalAddend * multiplier + addend;
+            }
+            addend = (multiplier + 1) * addend;
+            multiplier *= multiplier;
+        }
+        state = totalMultiplier * state + totalAddend;
+    }
+
+    uint64_t state;
+    uint64_t increment;
+};
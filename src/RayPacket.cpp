@@ -0,0 +1,165 @@
+// RayPacket.cpp
+
+#include "RayPacket.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace Simd;
+
+#if defined(SOFTRT_SIMD)
+
+namespace
+{
+
+// As in Bvh.cpp: at most kWidth - 1 entries per level
+const int kStackSize = (WideBvhNode::kWidth - 1) * 64 + 1;
+const uint32_t kNoHit = 0xffffffffu;
+
+} // namespace
+
+void ClosestHitPacket(const Bvh& bvh, const RayPacket& packet, float tMin, HitRecord* hits, bool* found)
+{
+    if (bvh.nodes.empty())
+    {
+        memset(found, 0, RayPacket::kSize * sizeof(bool));
+        return;
+    }
+
+    const Vector3& origin = packet.origin;
+    const Lanes directionX = Load(packet.directionX);
+    const Lanes directionY = Load(packet.directionY);
+    const Lanes directionZ = Load(packet.directionZ);
+    const Lanes one = Set1(1.0f);
+    const Lanes inverseX = Div(one, directionX);
+    const Lanes inverseY = Div(one, directionY);
+    const Lanes inverseZ = Div(one, directionZ);
+    const Lanes a = Add(Add(Mul(directionX, directionX), Mul(directionY, directionY)), Mul(directionZ, directionZ));
+    const Lanes zero = Set1(0.0f);
+    const Lanes minT = Set1(tMin);
+
+    Lanes tMax = Set1(FLT_MAX);
+    Lanes hitIndex = SetBits(kNoHit);
+
+    // One sphere against every lane; same arithmetic as IntersectNearest()
+    const SphereSoA& spheres = bvh.leafSpheres;
+    auto intersectLeaf = [&](uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            float ocX = origin.x - spheres.centerX[i];
+            float ocY = origin.y - spheres.centerY[i];
+            float ocZ = origin.z - spheres.centerZ[i];
+            float c = (ocX * ocX + ocY * ocY + ocZ * ocZ) - spheres.radiusSquared[i];
+
+            Lanes halfB = Add(Add(Mul(directionX, Set1(ocX)), Mul(directionY, Set1(ocY))), Mul(directionZ, Set1(ocZ)));
+            Lanes discriminant = Sub(Mul(halfB, halfB), Mul(a, Set1(c)));
+            Lanes hasRoots = CmpGe(discriminant, zero);
+            if (MoveMask(hasRoots) == 0)
+            {
+                continue;
+            }
+
+            Lanes sqrtDiscriminant = Sqrt(MaxLanes(discriminant, zero));
+            Lanes tNear = Div(Sub(zero, Add(halfB, sqrtDiscriminant)), a);
+            Lanes tFar = Div(Sub(sqrtDiscriminant, halfB), a);
+            Lanes t = Select(CmpGe(tNear, minT), tNear, tFar);
+
+            Lanes valid = And(hasRoots, And(CmpGe(t, minT), CmpLe(t, tMax)));
+            tMax = Select(valid, t, tMax);
+            hitIndex = Select(valid, SetBits(i), hitIndex);
+        }
+    };
+
+    float inverseXLanes[RayPacket::kSize];
+    float inverseYLanes[RayPacket::kSize];
+    float inverseZLanes[RayPacket::kSize];
+    Store(inverseXLanes, inverseX);
+    Store(inverseYLanes, inverseY);
+    Store(inverseZLanes, inverseZ);
+
+    // Entries carry the nearest lane's entry distance, so children beyond
+    // every lane's current hit are skipped when popped
+    uint32_t stack[kStackSize];
+    float stackEntry[kStackSize];
+    uint8_t stackCount[kStackSize]; // Leaf size, or 0 for a node
+    int stackSize = 0;
+    stack[stackSize] = 0;
+    stackEntry[stackSize] = tMin;
+    stackCount[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        --stackSize;
+        float laneTMax[RayPacket::kSize];
+        Store(laneTMax, tMax);
+        float farthestTMax = *std::max_element(laneTMax, laneTMax + RayPacket::kSize);
+        if (stackEntry[stackSize] > farthestTMax)
+        {
+            continue;
+        }
+
+        if (stackCount[stackSize] > 0)
+        {
+            intersectLeaf(stack[stackSize], stackCount[stackSize]);
+            continue;
+        }
+
+        const WideBvhNode& node = bvh.nodes[stack[stackSize]];
+        float nearestEntry[WideBvhNode::kWidth];
+        uint32_t mask = IntersectChildrenPacket(node, origin, inverseXLanes, inverseYLanes, inverseZLanes, RayPacket::kSize, tMin, laneTMax, nearestEntry);
+
+        // Push far first so the nearest child pops next
+        uint32_t order[WideBvhNode::kWidth];
+        uint32_t hitCount = 0;
+        for (uint32_t slot = 0; mask != 0; ++slot, mask >>= 1)
+        {
+            if ((mask & 1) == 0)
+            {
+                continue;
+            }
+            uint32_t i = hitCount++;
+            for (; i > 0 && nearestEntry[order[i - 1]] > nearestEntry[slot]; --i)
+            {
+                order[i] = order[i - 1];
+            }
+            order[i] = slot;
+        }
+        uint32_t targets[WideBvhNode::kWidth];
+        node.ChildTargets(targets);
+        while (hitCount > 0)
+        {
+            uint32_t slot = order[--hitCount];
+            stack[stackSize] = targets[slot];
+            stackEntry[stackSize] = nearestEntry[slot];
+            stackCount[stackSize++] = node.childPrimitives[slot];
+        }
+    }
+
+    float laneT[RayPacket::kSize];
+    float laneBits[RayPacket::kSize];
+    uint32_t laneIndex[RayPacket::kSize];
+    Store(laneT, tMax);
+    Store(laneBits, hitIndex);
+    memcpy(laneIndex, laneBits, sizeof(laneIndex));
+    for (uint32_t lane = 0; lane < RayPacket::kSize; ++lane)
+    {
+        found[lane] = laneIndex[lane] != kNoHit;
+        if (found[lane])
+        {
+            hits[lane].t = laneT[lane];
+            hits[lane].sphere = &(*bvh.spheres)[bvh.primitiveIndices[laneIndex[lane]]];
+            ComputeNormal(packet.LaneRay(lane), hits[lane]);
+        }
+    }
+}
+
+#else
+
+void ClosestHitPacket(const Bvh& bvh, const RayPacket& packet, float tMin, HitRecord* hits, bool* found)
+{
+    for (uint32_t lane = 0; lane < RayPacket::kSize; ++lane)
+    {
+        found[lane] = bvh.ClosestHit(packet.LaneRay(lane), tMin, FLT_MAX, hits[lane]);
+    }
+}
+
+#endif
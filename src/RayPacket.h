@@ -0,0 +1,31 @@
+// RayPacket.h
+
+#pragma once
+
+#include "Bvh.h"
+#include "Simd.h"
+
+// Coherent rays sharing an origin, one per SIMD lane. Camera passes fill a
+// kBlockWidth x kBlockHeight pixel block, lanes in row-major order.
+class RayPacket
+{
+public:
+    static const uint32_t kSize = Simd::kLanes;
+    static const int kBlockWidth = kSize >= 8 ? 4 : kSize >= 4 ? 2 : 1;
+    static const int kBlockHeight = static_cast<int>(kSize) / kBlockWidth;
+
+    Ray LaneRay(uint32_t lane) const
+    {
+        return Ray{ origin, Vector3{ directionX[lane], directionY[lane], directionZ[lane] } };
+    }
+
+    Vector3 origin;
+    float   directionX[kSize];
+    float   directionY[kSize];
+    float   directionZ[kSize];
+};
+
+// Traces the whole packet through the hierarchy at once: a node is culled
+// only when every lane misses it. Fills hits[lane] (including the normal)
+// and found[lane] for each lane.
+void ClosestHitPacket(const Bvh& bvh, const RayPacket& packet, float tMin, HitRecord* hits, bool* found);
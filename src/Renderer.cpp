@@ -0,0 +1,266 @@
+// Renderer.cpp
+
+#include "Renderer.h"
+#include "PathTracer.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cfloat>
+
+// Rays traced by the calling thread; read by RenderPass and the benchmarks
+thread_local uint64_t threadRayCount = 0;
+
+uint64_t ThreadRayCount()
+{
+    return threadRayCount;
+}
+
+// Triangles are searched only up to the nearest sphere
+bool TraceRayClosest(const Ray& ray, const Scene& scene, HitRecord& hit)
+{
+    bool found = scene.bvh.ClosestHit(ray, 0.0f, FLT_MAX, hit);
+    return scene.triangleBvh.ClosestHit(ray, 0.0f, found ? hit.t : FLT_MAX, hit) || found;
+}
+
+bool TraceRayOcclusion(const Ray& ray, const Scene& scene, float maxDistance, bool cullBehindOrigin)
+{
+    ++threadRayCount;
+    return scene.bvh.AnyHit(ray, 0.0f, maxDistance, cullBehindOrigin) || scene.triangleBvh.AnyHit(ray, 0.0f, maxDistance);
+}
+
+// Shades one path vertex, tracing its shadow rays immediately. Returns false
+// when the path ends here; otherwise replaces ray with the bounce ray.
+bool ShadeHit(Ray& ray, const HitRecord& hit, const Scene& scene, const RenderSettings& settings, const Vector3& cameraPosition, int bounce, Random& random, Vector3& throughput, Vector3& radiance)
+{
+    SurfaceSample surface = SampleSurface(scene, ray, hit, cameraPosition);
+    bool occluded = TraceRayOcclusion({ surface.origin, LightDir }, scene);
+
+    int lightSamples = LightSampleCount(scene, settings);
+    float diffuseWeight = DiffuseWeight(surface, bounce, settings.maxBounces);
+    for (int i = 0; i < lightSamples; ++i)
+    {
+        LightSample light;
+        if (SampleLocalLight(scene, surface, diffuseWeight, lightSamples, random, light) &&
+            !TraceRayOcclusion({ surface.origin, light.direction }, scene, light.distance))
+        {
+            radiance = radiance + throughput * light.contribution;
+        }
+    }
+
+    return FinishSurface(surface, occluded, bounce, settings.maxBounces, throughput, radiance) &&
+        SampleBounce(surface, settings, random, throughput, ray) &&
+        SurviveRoulette(settings, bounce, random, throughput);
+}
+
+// Continues a path whose first hit is already known, bouncing until the
+// path escapes to the sky, stops contributing, loses the roulette or
+// reaches settings.maxBounces
+Vector3 TracePathFromHit(Ray ray, HitRecord hit, const Scene& scene, const RenderSettings& settings, const Vector3& cameraPosition, Random& random)
+{
+    Vector3 radiance(0.0f);
+    Vector3 throughput(1.0f);
+    for (int bounce = 0; ShadeHit(ray, hit, scene, settings, cameraPosition, bounce, random, throughput, radiance); ++bounce)
+    {
+        ++threadRayCount;
+        if (!TraceRayClosest(ray, scene, hit))
+        {
+            radiance = radiance + throughput * SkyCol;
+            break;
+        }
+    }
+    return radiance;
+}
+
+Vector3 TracePath(const Ray& ray, const Scene& scene, const RenderSettings& settings, const Vector3& cameraPosition, Random& random)
+{
+    ++threadRayCount;
+    HitRecord hit;
+    if (!TraceRayClosest(ray, scene, hit))
+    {
+        return SkyCol;
+    }
+    return TracePathFromHit(ray, hit, scene, settings, cameraPosition, random);
+}
+
+// Traces the camera ray of pixel (i, j) and records its guide features
+Vector3 TraceCameraRay(const Ray& ray, const Scene& scene, AccumulationBuffer& accumulation, const RenderSettings& settings, const Vector3& cameraPosition, int i, int j, Random& random)
+{
+    ++threadRayCount;
+    HitRecord hit;
+    bool found = TraceRayClosest(ray, scene, hit);
+    RecordFeatures(accumulation, scene, i, j, ray, found ? &hit : nullptr);
+    return found ? TracePathFromHit(ray, hit, scene, settings, cameraPosition, random) : SkyCol;
+}
+
+class Tile
+{
+public:
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+void RenderTilePackets(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings, const Vector3& camPos, const Tile& tile)
+{
+    RayPacket packet;
+    packet.origin = camPos;
+    HitRecord hits[RayPacket::kSize];
+    bool found[RayPacket::kSize];
+    bool active[RayPacket::kSize];
+    Random laneRandom[RayPacket::kSize];
+
+    for (int blockY = tile.y0; blockY < tile.y1; blockY += RayPacket::kBlockHeight)
+    {
+        for (int blockX = tile.x0; blockX < tile.x1; blockX += RayPacket::kBlockWidth)
+        {
+            // Lanes past the tile edge repeat the last pixel and are discarded
+            uint32_t validLanes = 0;
+            uint32_t activeLanes = 0;
+            for (uint32_t lane = 0; lane < RayPacket::kSize; ++lane)
+            {
+                int i = blockX + static_cast<int>(lane) % RayPacket::kBlockWidth;
+                int j = blockY + static_cast<int>(lane) / RayPacket::kBlockWidth;
+                bool valid = i < tile.x1 && j < tile.y1;
+                active[lane] = valid && PixelActive(accumulation, settings, i, j);
+                validLanes += valid ? 1 : 0;
+                activeLanes += active[lane] ? 1 : 0;
+                if (valid && !active[lane])
+                {
+                    continue;
+                }
+
+                i = Min(i, tile.x1 - 1);
+                j = Min(j, tile.y1 - 1);
+                float offsetX;
+                float offsetY;
+                laneRandom[lane] = PixelRandom(i, j, accumulation.sampleCount);
+                PixelSampleOffset(accumulation.sampleCount, laneRandom[lane], offsetX, offsetY);
+                Vector3 direction = CameraRayDirection(framebuffer, i, j, offsetX, offsetY);
+                packet.directionX[lane] = direction.x;
+                packet.directionY[lane] = direction.y;
+                packet.directionZ[lane] = direction.z;
+            }
+
+            if (activeLanes == 0)
+            {
+                continue;
+            }
+
+            // Only partly converged blocks are traced lane by lane
+            bool tracePacket = activeLanes == validLanes;
+            if (tracePacket)
+            {
+                ClosestHitPacket(scene.bvh, packet, 0.0f, hits, found);
+                // Triangles are traced per lane, up to each lane's sphere hit
+                for (uint32_t lane = 0; lane < RayPacket::kSize; ++lane)
+                {
+                    found[lane] = scene.triangleBvh.ClosestHit(packet.LaneRay(lane), 0.0f, found[lane] ? hits[lane].t : FLT_MAX, hits[lane]) || found[lane];
+                }
+            }
+
+            for (uint32_t lane = 0; lane < RayPacket::kSize; ++lane)
+            {
+                if (!active[lane])
+                {
+                    continue;
+                }
+                int i = blockX + static_cast<int>(lane) % RayPacket::kBlockWidth;
+                int j = blockY + static_cast<int>(lane) / RayPacket::kBlockWidth;
+
+                Vector3 color;
+                if (tracePacket)
+                {
+                    ++threadRayCount;
+                    RecordFeatures(accumulation, scene, i, j, packet.LaneRay(lane), found[lane] ? &hits[lane] : nullptr);
+                    color = found[lane] ? TracePathFromHit(packet.LaneRay(lane), hits[lane], scene, settings, camPos, laneRandom[lane]) : SkyCol;
+                }
+                else
+                {
+                    color = TraceCameraRay(packet.LaneRay(lane), scene, accumulation, settings, camPos, i, j, laneRandom[lane]);
+                }
+                framebuffer.SetPixel(i, j, accumulation.Accumulate(i, j, color));
+            }
+        }
+    }
+}
+
+void RenderTile(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings, const Vector3& camPos, const Tile& tile)
+{
+    for (int i = tile.x0; i < tile.x1; ++i)
+    {
+        for (int j = tile.y0; j < tile.y1; ++j)
+        {
+            if (!PixelActive(accumulation, settings, i, j))
+            {
+                continue;
+            }
+
+            Ray ray;
+            ray.origin = camPos;
+
+            float offsetX;
+            float offsetY;
+            Random random = PixelRandom(i, j, accumulation.sampleCount);
+            PixelSampleOffset(accumulation.sampleCount, random, offsetX, offsetY);
+            ray.direction = CameraRayDirection(framebuffer, i, j, offsetX, offsetY);
+            Vector3 color = TraceCameraRay(ray, scene, accumulation, settings, camPos, i, j, random);
+            framebuffer.SetPixel(i, j, accumulation.Accumulate(i, j, color));
+        }
+    }
+}
+
+uint64_t RenderPass(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings)
+{
+    const Vector3& camPos = settings.cameraPosition;
+    if (settings.useWavefront)
+    {
+        uint64_t rayCount = RenderPassWavefront(scene, accumulation, framebuffer, settings, camPos);
+        accumulation.ClearReused();
+        return rayCount;
+    }
+
+    int tileSize = settings.tileSize > 0 ? settings.tileSize : 32;
+    int tilesX = (framebuffer.width + tileSize - 1) / tileSize;
+    int tilesY = (framebuffer.height + tileSize - 1) / tileSize;
+
+    // Every pixel is computed independently, so the image does not depend on
+    // which thread renders which tile
+    std::atomic<uint64_t> rayCount(0);
+    ThreadPool& pool = SharedThreadPool(settings.threadCount);
+    pool.ParallelFor(static_cast<uint32_t>(tilesX * tilesY), [&](uint32_t tileIndex, int)
+    {
+        uint64_t tileStartRayCount = threadRayCount;
+        Tile tile;
+        tile.x0 = static_cast<int>(tileIndex) % tilesX * tileSize;
+        tile.y0 = static_cast<int>(tileIndex) / tilesX * tileSize;
+        tile.x1 = Min(tile.x0 + tileSize, framebuffer.width);
+        tile.y1 = Min(tile.y0 + tileSize, framebuffer.height);
+        if (settings.usePackets)
+        {
+            RenderTilePackets(scene, accumulation, framebuffer, settings, camPos, tile);
+        }
+        else
+        {
+            RenderTile(scene, accumulation, framebuffer, settings, camPos, tile);
+        }
+        rayCount += threadRayCount - tileStartRayCount;
+    });
+
+    ++accumulation.sampleCount;
+    accumulation.ClearReused();
+    return rayCount;
+}
+
+uint64_t Render(const Scene& scene, Framebuffer& framebuffer, const RenderSettings& settings)
+{
+    AccumulationBuffer accumulation(framebuffer.width, framebuffer.height);
+    return RenderPass(scene, accumulation, framebuffer, settings);
+}
+
+void Render(Framebuffer& framebuffer)
+{
+    Scene scene;
+    BuildDefaultScene(scene);
+    Render(scene, framebuffer);
+}
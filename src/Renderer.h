@@ -0,0 +1,70 @@
+// Renderer.h
+
+#pragma once
+
+#include "Framebuffer.h"
+#include "Random.h"
+#include "Scene.h"
+#include <cfloat>
+#include <cstdint>
+
+// Nearest sphere or triangle hit along the ray
+bool TraceRayClosest(const Ray& ray, const Scene& scene, HitRecord& hit);
+
+// Any-hit shadow query; stops at the first occluder closer than maxDistance
+// (in units of ray.direction)
+bool TraceRayOcclusion(const Ray& ray, const Scene& scene, float maxDistance = FLT_MAX, bool cullBehindOrigin = true);
+
+// Running count of camera, bounce and shadow rays traced on this thread
+uint64_t ThreadRayCount();
+
+class RenderSettings
+{
+public:
+    // Camera position; it looks down +z, and the view only translates
+    Vector3 cameraPosition{ 0.0f, 0.0f, -2.0f };
+
+    bool usePackets = true;    // Trace camera rays in SIMD packets
+    bool useWavefront = false; // Trace the whole image stage by stage instead of per pixel
+    int  threadCount = 0;      // Render threads; 0 uses every hardware thread
+    int  tileSize = 32;        // Tile edge in pixels; tiles are the unit of work
+
+    // Adaptive sampling. A pixel stops receiving samples once it has at
+    // least minSamples and the standard error of its mean luminance is
+    // below noiseThreshold times that mean. 0 samples every pixel every pass.
+    float noiseThreshold = 0.0f;
+    int   minSamples = 4;
+
+    // Path length. Every path may take up to maxBounces bounces; after
+    // rouletteMinBounces of them, Russian roulette ends low-throughput paths
+    // early without biasing the image. A negative value disables roulette.
+    int maxBounces = 8;
+    int rouletteMinBounces = 3;
+
+    // Importance sample bounce directions from the material's diffuse and
+    // GGX lobes instead of bouncing along the normal
+    bool sampleBounces = false;
+
+    // Next-event estimates per vertex toward the scene's local lights, each
+    // picked from the light tree with one shadow ray (at most 4)
+    int lightSamples = 1;
+};
+
+// Radiance along a camera ray
+Vector3 TracePath(const Ray& ray, const Scene& scene, const RenderSettings& settings, const Vector3& cameraPosition, Random& random);
+
+// Progressive rendering: adds one sample per pixel to the accumulation
+// buffer and writes the running average to the framebuffer. Both buffers
+// must have the same size; Reset() the accumulation when the scene changes,
+// and Reset() or Reproject() it when the camera moves. With adaptive
+// sampling only unconverged pixels are traced, and pixels whose history was
+// reprojected since the last pass are skipped once.
+// Returns the number of rays traced; 0 once every pixel has converged.
+uint64_t RenderPass(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings = RenderSettings());
+
+// Renders the scene into the framebuffer at the framebuffer's resolution.
+// Returns the number of rays traced.
+uint64_t Render(const Scene& scene, Framebuffer& framebuffer, const RenderSettings& settings = RenderSettings());
+
+// Builds the default scene and renders it
+void Render(Framebuffer& framebuffer);
@@ -0,0 +1,118 @@
+// Sampling.h
+
+#pragma once
+
+#include "Vector3.h"
+
+// A sampled direction and its probability density (per unit solid angle)
+class DirectionSample
+{
+public:
+    Vector3 direction;
+    float   pdf;
+};
+
+// Orthonormal basis around a unit normal without branches on the normal's
+// direction (Duff et al., "Building an Orthonormal Basis, Revisited")
+inline void BuildBasis(const Vector3& normal, Vector3& tangent, Vector3& bitangent)
+{
+    float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + normal.z);
+    float b = normal.x * normal.y * a;
+    tangent = { 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+    bitangent = { b, sign + normal.y * normal.y * a, -normal.y };
+}
+
+inline Vector3 FromBasis(const Vector3& normal, float x, float y, float z)
+{
+    Vector3 tangent;
+    Vector3 bitangent;
+    BuildBasis(normal, tangent, bitangent);
+    return tangent * x + bitangent * y + normal * z;
+}
+
+// Cosine-weighted hemisphere around normal from two uniforms in [0, 1)
+inline DirectionSample SampleCosineHemisphere(const Vector3& normal, float u1, float u2)
+{
+    float radius = sqrtf(u1);
+    float phi = 2.0f * kPi * u2;
+    float cosTheta = sqrtf(Max(1.0f - u1, 0.0f));
+
+    DirectionSample sample;
+    sample.direction = FromBasis(normal, radius * cosf(phi), radius * sinf(phi), cosTheta);
+    sample.pdf = cosTheta * (1.0f / kPi);
+    return sample;
+}
+
+inline float CosineHemispherePdf(const Vector3& normal, const Vector3& direction)
+{
+    return Max(normal.Dot(direction), 0.0f) * (1.0f / kPi);
+}
+
+// GGX (Trowbridge-Reitz) microfacet distribution. alpha is the usual
+// remapped roughness (roughness squared).
+inline float GgxDistribution(float cosThetaH, float alpha)
+{
+    float alpha2 = alpha * alpha;
+    float d = cosThetaH * cosThetaH * (alpha2 - 1.0f) + 1.0f;
+    return alpha2 / (kPi * d * d);
+}
+
+// Smith masking term for one direction
+inline float GgxMasking(float cosTheta, float alpha)
+{
+    float alpha2 = alpha * alpha;
+    return 2.0f * cosTheta / (cosTheta + sqrtf(alpha2 + (1.0f - alpha2) * cosTheta * cosTheta));
+}
+
+// Density of reflecting outgoing about a half vector drawn from D(h) cos(h)
+inline float GgxReflectionPdf(const Vector3& normal, const Vector3& outgoing, const Vector3& incoming, float alpha)
+{
+    Vector3 half = (outgoing + incoming).Normalize();
+    float cosThetaH = normal.Dot(half);
+    float outgoingDotHalf = outgoing.Dot(half);
+    if (cosThetaH <= 0.0f || outgoingDotHalf <= 0.0f)
+    {
+        return 0.0f;
+    }
+    return GgxDistribution(cosThetaH, alpha) * cosThetaH / (4.0f * outgoingDotHalf);
+}
+
+// GGX reflection toward outgoing from incoming, times the cosine at the
+// incoming side. Fresnel is taken as 1.
+inline float GgxReflectance(const Vector3& normal, const Vector3& outgoing, const Vector3& incoming, float alpha)
+{
+    float cosOutgoing = normal.Dot(outgoing);
+    float cosIncoming = normal.Dot(incoming);
+    if (cosOutgoing <= 0.0f || cosIncoming <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float cosThetaH = normal.Dot((outgoing + incoming).Normalize());
+    float masking = GgxMasking(cosOutgoing, alpha) * GgxMasking(cosIncoming, alpha);
+    return GgxDistribution(cosThetaH, alpha) * masking / (4.0f * cosOutgoing);
+}
+
+// Importance samples the GGX lobe: draws a half vector from D(h) cos(h) and
+// reflects outgoing (a unit vector away from the surface) about it. The pdf
+// is 0 if the reflection ends up below the surface.
+inline DirectionSample SampleGgxReflection(const Vector3& normal, const Vector3& outgoing, float alpha, float u1, float u2)
+{
+    float alpha2 = alpha * alpha;
+    float cosThetaH2 = (1.0f - u1) / (1.0f + (alpha2 - 1.0f) * u1);
+    float cosThetaH = sqrtf(cosThetaH2);
+    float sinThetaH = sqrtf(Max(1.0f - cosThetaH2, 0.0f));
+    float phi = 2.0f * kPi * u2;
+    Vector3 half = FromBasis(normal, sinThetaH * cosf(phi), sinThetaH * sinf(phi), cosThetaH);
+
+    DirectionSample sample;
+    float outgoingDotHalf = outgoing.Dot(half);
+    sample.direction = half * (2.0f * outgoingDotHalf) - outgoing;
+    sample.pdf = 0.0f;
+    if (outgoingDotHalf > 0.0f && normal.Dot(sample.direction) > 0.0f)
+    {
+        sample.pdf = GgxDistribution(cosThetaH, alpha) * cosThetaH / (4.0f * outgoingDotHalf);
+    }
+    return sample;
+}
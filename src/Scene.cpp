@@ -0,0 +1,224 @@
+// Scene.cpp
+
+#include "Scene.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+namespace
+{
+
+// Spheres generated or animated per thread pool task
+const uint32_t kGenerateChunkSize = 1 << 16;
+
+// Spheres at least this large are scenery and never animated
+const float kStaticRadius = 100.0f;
+
+void AddStockMaterials(Scene& scene)
+{
+    Buffer<Material>& materials = scene.materials;
+    materials.clear();
+    materials.emplace_back(Material{ Vector3{0.75f, 1.0f, 0.75f}, 0.975f });
+    materials.emplace_back(Material{ Vector3{0.0f, 0.0f, 1.0f}, 0.9f });
+    materials.emplace_back(Material{ Vector3{1.0f, 0.0f, 0.0f}, 0.9f });
+    materials.emplace_back(Material{ Vector3{0.0f, 1.0f, 0.0f}, 1.0f });
+    materials.emplace_back(Material{ Vector3{1.0f, 1.0f, 0.0f}, 0.985f });
+    materials.emplace_back(Material{ Vector3{0.0f, 1.0f, 1.0f}, 0.985f });
+    materials.emplace_back(Material{ Vector3{1.0f, 0.0f, 1.0f}, 0.985f });
+    materials.emplace_back(Material{ Vector3{1.0f, 1.0f, 1.0f}, 0.95f });
+    materials.emplace_back(Material{ Vector3{0.25f, 0.25f, 1.0f}, 0.95f });
+    materials.emplace_back(Material{ Vector3{1.0f, 0.25f, 0.25f}, 0.95f });
+    materials.emplace_back(Material{ Vector3{0.5f, 1.0f, 0.25f}, 0.95f });
+    materials.emplace_back(Material{ Vector3{1.0f, 1.0f, 0.25f}, 0.9f });
+    materials.emplace_back(Material{ Vector3{0.25f, 1.0f, 1.0f}, 0.9f });
+    materials.emplace_back(Material{ Vector3{1.0f, 0.25f, 1.0f}, 0.9f });
+}
+
+// Total intensity stays the same whatever the light count, so adding
+// lights changes the noise and the look but not the overall exposure
+void AddRandomLights(Scene& scene, int lightCount)
+{
+    Random lightRandom(47);
+    Buffer<Light>& lights = scene.lights;
+    lights.clear();
+    lights.reserve(lightCount);
+    for (int i = 0; i < lightCount; ++i)
+    {
+        Light light;
+        light.type = static_cast<LightType>(i % 3);
+        light.position = Vector3{ lightRandom.NextFloatSigned() * 6.0f, 0.5f + lightRandom.NextFloat() * 5.0f, lightRandom.NextFloat() * 10.0f };
+        Vector3 color = scene.materials[i % scene.materials.size()].color;
+        light.intensity = color * (12.0f / static_cast<float>(lightCount));
+        light.direction = Vector3{ lightRandom.NextFloatSigned() * 0.5f, -1.0f, lightRandom.NextFloatSigned() * 0.5f }.Normalize();
+        light.cosInner = 0.9f;
+        light.cosOuter = 0.75f;
+        light.radius = 0.05f + lightRandom.NextFloat() * 0.25f;
+        lights.push_back(light);
+    }
+}
+
+// Sizes the sphere arrays for count generated spheres plus the floor, fills
+// chunks of them in parallel with generate(first, last), then adds the
+// floor and builds the hierarchies
+template< typename Generate >
+void GenerateSpheres(Scene& scene, uint32_t count, int lightCount, int threadCount, const Generate& generate)
+{
+    scene.spheres.resize(count + 1);
+    scene.sphereMaterials.resize(count + 1);
+    uint32_t chunkCount = (count + kGenerateChunkSize - 1) / kGenerateChunkSize;
+    SharedThreadPool(threadCount).ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kGenerateChunkSize;
+        generate(first, std::min(first + kGenerateChunkSize, count));
+    });
+    scene.spheres[count] = Sphere{ { 0.0f, -1000.0f, 5.0f }, 999.0f };
+    scene.sphereMaterials[count] = 0;
+    scene.vertices.clear();
+    scene.vertexNormals.clear();
+    scene.triangles.clear();
+    scene.triangleMaterials.clear();
+
+    scene.bvh.Build(scene.spheres, threadCount);
+    scene.triangleBvh.Build(scene.vertices, scene.vertexNormals, scene.triangles, threadCount);
+    AddRandomLights(scene, lightCount);
+    scene.lightTree.Build(scene.lights);
+}
+
+} // namespace
+
+SceneMemory MeasureSceneMemory(const Scene& scene)
+{
+    SceneMemory memory;
+    memory.materials = scene.materials.size() * sizeof(Material);
+    memory.spheres = scene.spheres.size() * sizeof(Sphere) + scene.sphereMaterials.size() * sizeof(uint16_t);
+    memory.meshes = (scene.vertices.size() + scene.vertexNormals.size()) * sizeof(Vector3) +
+        scene.triangles.size() * sizeof(Triangle) + scene.triangleMaterials.size() * sizeof(uint16_t);
+    memory.bvh = scene.bvh.MemoryBytes() + scene.triangleBvh.MemoryBytes();
+    memory.lights = scene.lights.size() * sizeof(Light) + scene.lightTree.nodes.size() * sizeof(LightTreeNode);
+    return memory;
+}
+
+void PrintSceneMemory(const Scene& scene)
+{
+    SceneMemory memory = MeasureSceneMemory(scene);
+    size_t primitiveCount = scene.spheres.size() + scene.triangles.size();
+    printf("Memory: %.1f KiB (spheres %.1f, meshes %.1f, BVH %.1f, lights %.1f, materials %.1f), %.1f bytes per primitive\n",
+        memory.Total() / 1024.0, memory.spheres / 1024.0, memory.meshes / 1024.0, memory.bvh / 1024.0, memory.lights / 1024.0, memory.materials / 1024.0,
+        primitiveCount == 0 ? 0.0 : static_cast<double>(memory.Total()) / primitiveCount);
+}
+
+void BuildDefaultScene(Scene& scene, int sphereCount, int lightCount, int threadCount)
+{
+    AddStockMaterials(scene);
+
+    // Each chunk jumps ahead to its own part of one sequence (four draws per
+    // sphere), so the spheres match a serial loop whatever the thread count
+    const Random random(43);
+    uint16_t materialCount = static_cast<uint16_t>(scene.materials.size());
+    GenerateSpheres(scene, static_cast<uint32_t>(sphereCount), lightCount, threadCount, [&](uint32_t first, uint32_t last)
+    {
+        Random chunkRandom = random;
+        chunkRandom.Advance(4ull * first);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            float randX = chunkRandom.NextFloatSigned() * 5.0f;
+            float randY = chunkRandom.NextFloat() * 5.0f;
+            float randZ = chunkRandom.NextFloat() * 10.0f;
+            float randRadius = chunkRandom.NextFloat() * 1.25f;
+            scene.spheres[i] = Sphere{ { randX, randY, randZ }, randRadius };
+            scene.sphereMaterials[i] = static_cast<uint16_t>(i % materialCount);
+        }
+    });
+}
+
+void BuildPointCloudScene(Scene& scene, int pointCount, int lightCount, int threadCount)
+{
+    AddStockMaterials(scene);
+
+    class Shape
+    {
+    public:
+        Vector3  center;
+        float    radius;
+        uint16_t material;
+    };
+    const Shape kShapes[] = {
+        { { -1.5f, 0.0f, 5.0f }, 1.0f, 9 },
+        { { 0.5f, -0.5f, 4.0f }, 0.5f, 7 },
+        { { 1.8f, 0.25f, 6.0f }, 1.25f, 8 },
+    };
+    const int kShapeCount = sizeof(kShapes) / sizeof(kShapes[0]);
+
+    // Points are spread by area; their radius is a little over half the mean
+    // spacing so neighbours overlap
+    float totalArea = 0.0f;
+    for (const Shape& shape : kShapes)
+    {
+        totalArea += 4.0f * kPi * shape.radius * shape.radius;
+    }
+    float pointRadius = 0.6f * sqrtf(totalArea / static_cast<float>(std::max(pointCount, 1)));
+
+    GenerateSpheres(scene, static_cast<uint32_t>(pointCount), lightCount, threadCount, [&](uint32_t first, uint32_t last)
+    {
+        Random random(53, first / kGenerateChunkSize);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            float pick = random.NextFloat() * totalArea;
+            int shapeIndex = 0;
+            for (; shapeIndex + 1 < kShapeCount; ++shapeIndex)
+            {
+                float area = 4.0f * kPi * kShapes[shapeIndex].radius * kShapes[shapeIndex].radius;
+                if (pick < area)
+                {
+                    break;
+                }
+                pick -= area;
+            }
+
+            // Uniform direction on the unit sphere
+            const Shape& shape = kShapes[shapeIndex];
+            float z = random.NextFloatSigned();
+            float phi = 2.0f * kPi * random.NextFloat();
+            float ring = sqrtf(Max(1.0f - z * z, 0.0f));
+            Vector3 direction{ ring * cosf(phi), ring * sinf(phi), z };
+            scene.spheres[i] = Sphere{ shape.center + direction * shape.radius, pointRadius };
+            scene.sphereMaterials[i] = shape.material;
+        }
+    });
+}
+
+void SphereAnimation::Capture(const Scene& scene)
+{
+    rest.assign(scene.spheres.begin(), scene.spheres.end());
+}
+
+void SphereAnimation::Apply(Scene& scene, float time, int threadCount) const
+{
+    uint32_t count = static_cast<uint32_t>(std::min(rest.size(), scene.spheres.size()));
+    uint32_t chunkCount = (count + kGenerateChunkSize - 1) / kGenerateChunkSize;
+    SharedThreadPool(threadCount).ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kGenerateChunkSize;
+        uint32_t last = std::min(first + kGenerateChunkSize, count);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            const Sphere& sphere = rest[i];
+            if (sphere.radius >= kStaticRadius)
+            {
+                scene.spheres[i] = sphere;
+                continue;
+            }
+
+            // Sphere i's motion comes from stream i, so it is the same
+            // whatever the chunking
+            Random random(67, i);
+            Vector3 direction = Vector3{ random.NextFloatSigned(), random.NextFloatSigned(), random.NextFloatSigned() }.Normalize();
+            float rate = 0.5f + random.NextFloat();
+            float phase = 2.0f * kPi * random.NextFloat();
+            float offset = amplitude * (sinf(rate * time + phase) - sinf(phase));
+            scene.spheres[i] = Sphere{ sphere.center + direction * offset, sphere.radius };
+        }
+    });
+}
@@ -0,0 +1,94 @@
+// Scene.h
+
+#pragma once
+
+#include "Bvh.h"
+#include "Light.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+#include <vector>
+
+// Materials, spheres, triangle meshes, local lights and the hierarchies over
+// them. Sphere i uses materials[sphereMaterials[i]]; keeping the index out of
+// Sphere holds it to 16 bytes. Triangle i likewise uses
+// triangleMaterials[i]; every mesh shares one vertex array. Spheres and
+// triangles have a hierarchy each and rays query both (see TraceRayClosest).
+// The hierarchies point at the arrays, so a Scene is built in place and
+// never copied. When loaded from a scene cache every array views cacheFile.
+// The directional key light is part of the shading model and is not in the
+// light list.
+class Scene
+{
+public:
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    static const size_t kMaxMaterials = 65536;
+
+    const Material& MaterialOf(const HitRecord& hit) const
+    {
+        return materials[hit.sphere ? sphereMaterials[hit.sphere - spheres.data()] : triangleMaterials[hit.triangle]];
+    }
+
+    MappedFile       cacheFile; // Declared first so it is unmapped last
+    Buffer<Material> materials;
+    Buffer<Sphere>   spheres;
+    Buffer<uint16_t> sphereMaterials;
+    Bvh              bvh;
+    Buffer<Vector3>  vertices;
+    Buffer<Vector3>  vertexNormals; // Empty, or zero where a vertex has no normal
+    Buffer<Triangle> triangles;
+    Buffer<uint16_t> triangleMaterials;
+    TriangleBvh      triangleBvh;
+    Buffer<Light>    lights;
+    LightTree        lightTree;
+};
+
+// Bytes held by each part of a scene, whether owned or mapped
+class SceneMemory
+{
+public:
+    size_t Total() const
+    {
+        return materials + spheres + meshes + bvh + lights;
+    }
+
+    size_t materials = 0;
+    size_t spheres = 0; // Spheres and their material indices
+    size_t meshes = 0;  // Vertices, normals, triangles and their material indices
+    size_t bvh = 0;     // Both hierarchies
+    size_t lights = 0;  // Lights and the light tree
+};
+
+SceneMemory MeasureSceneMemory(const Scene& scene);
+void PrintSceneMemory(const Scene& scene);
+
+// The stock scene: 14 materials, sphereCount random spheres, a floor and
+// lightCount random point, spot and sphere lights. Spheres are generated
+// and the hierarchy is built on threadCount threads (0 uses all of them);
+// the result does not depend on the thread count.
+void BuildDefaultScene(Scene& scene, int sphereCount = 40, int lightCount = 0, int threadCount = 0);
+
+// pointCount small spheres scattered over the surfaces of three large
+// spheres on the stock floor, sized so the surfaces read as closed at any
+// count. Lights and threads as for BuildDefaultScene.
+void BuildPointCloudScene(Scene& scene, int pointCount, int lightCount = 0, int threadCount = 0);
+
+// Motion for a scene's spheres: each swings back and forth along its own
+// random direction at its own rate and phase, so neighbours drift apart and
+// back together. Spheres too large to move plausibly, such as the stock
+// floor, stay put. Only the spheres change; the caller brings the hierarchy
+// up to date (see Bvh::Update).
+class SphereAnimation
+{
+public:
+    // Takes the scene's current spheres as the pose at time 0
+    void Capture(const Scene& scene);
+
+    // Moves the spheres to their pose at time seconds, in parallel
+    void Apply(Scene& scene, float time, int threadCount = 0) const;
+
+    float               amplitude = 0.5f; // Largest offset from the rest pose
+    std::vector<Sphere> rest;
+};
@@ -0,0 +1,762 @@
+// SceneFile.cpp
+
+#include "SceneFile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+const char kCacheMagic[8] = { 'S', 'o', 'f', 't', 'R', 'T', 'S', 'C' };
+const uint32_t kCacheVersion = 6;
+const uint32_t kByteOrderMark = 0x01020304;
+
+// Sections start on cache line boundaries so the mapped arrays are aligned
+const uint64_t kSectionAlignment = 64;
+
+enum CacheSection
+{
+    kMaterials,
+    kSpheres,
+    kSphereMaterials,
+    kLights,
+    kBvhNodes,
+    kBvhIndices,
+    kLeafCenterX,
+    kLeafCenterY,
+    kLeafCenterZ,
+    kLeafRadiusSquared,
+    kLightNodes,
+    kVertices,
+    kVertexNormals,
+    kTriangles,
+    kTriangleMaterials,
+    kTriangleNodes,
+    kTriangleIndices,
+    kLeafV0X,
+    kLeafV0Y,
+    kLeafV0Z,
+    kLeafEdge1X,
+    kLeafEdge1Y,
+    kLeafEdge1Z,
+    kLeafEdge2X,
+    kLeafEdge2Y,
+    kLeafEdge2Z,
+    kSectionCount
+};
+
+class CacheSectionHeader
+{
+public:
+    uint64_t offset;
+    uint64_t count;
+    uint32_t elementSize;
+    uint32_t reserved;
+};
+
+class CacheHeader
+{
+public:
+    char               magic[8];
+    uint32_t           version;
+    uint32_t           byteOrder;
+    uint64_t           sourceKey;
+    uint32_t           bvhBuilder;  // BvhBuilder of the sphere hierarchy
+    uint32_t           bvhTreelets; // 1 if its Morton tree was treelet optimized
+    uint32_t           bvhLeafCount;
+    uint32_t           bvhMaxDepth;
+    uint32_t           triangleLeafCount;
+    uint32_t           triangleMaxDepth;
+    float              bvhSahCost;
+    float              triangleSahCost;
+    CacheSectionHeader sections[kSectionCount];
+};
+
+class SectionData
+{
+public:
+    const void* data;
+    uint64_t    count;
+    uint32_t    elementSize;
+};
+
+template< typename T >
+SectionData Section(const Buffer<T>& buffer)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "cached arrays are written as raw bytes");
+    return SectionData{ buffer.data(), buffer.size(), static_cast<uint32_t>(sizeof(T)) };
+}
+
+// Points buffer at a validated section of the mapped cache
+template< typename T >
+bool ViewSection(const MappedFile& file, const CacheSectionHeader& section, Buffer<T>& buffer)
+{
+    if (section.elementSize != sizeof(T) || section.offset % kSectionAlignment != 0 || section.offset > file.Size() ||
+        section.count > (file.Size() - section.offset) / sizeof(T))
+    {
+        return false;
+    }
+    buffer.View(reinterpret_cast<T*>(file.Data() + section.offset), static_cast<size_t>(section.count));
+    return true;
+}
+
+// FNV-1a
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+const uint64_t kHashSeed = 0xcbf29ce484222325ull;
+
+void ClearScene(Scene& scene)
+{
+    scene.materials.clear();
+    scene.spheres.clear();
+    scene.sphereMaterials.clear();
+    scene.vertices.clear();
+    scene.vertexNormals.clear();
+    scene.triangles.clear();
+    scene.triangleMaterials.clear();
+    scene.lights.clear();
+    scene.bvh.Clear();
+    scene.triangleBvh.Clear();
+    scene.lightTree.nodes.clear();
+    scene.cacheFile.Close();
+}
+
+// Whitespace-separated tokens of one line of a text scene
+class LineReader
+{
+public:
+    LineReader(const char* inBegin, const char* inEnd)
+        : cursor(inBegin)
+        , end(inEnd)
+    {}
+
+    bool Word(std::string& word)
+    {
+        SkipSpace();
+        const char* start = cursor;
+        while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+        {
+            ++cursor;
+        }
+        word.assign(start, cursor);
+        return !word.empty();
+    }
+
+    bool Number(float& value)
+    {
+        std::string word;
+        if (!Word(word))
+        {
+            return false;
+        }
+        char* parsedEnd = nullptr;
+        value = strtof(word.c_str(), &parsedEnd);
+        return *parsedEnd == '\0';
+    }
+
+    bool Vector(Vector3& value)
+    {
+        return Number(value.x) && Number(value.y) && Number(value.z);
+    }
+
+    bool AtEnd()
+    {
+        SkipSpace();
+        return cursor == end;
+    }
+
+private:
+    void SkipSpace()
+    {
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+        {
+            ++cursor;
+        }
+    }
+
+    const char* cursor;
+    const char* end;
+};
+
+bool ReadFile(const char* path, std::vector<char>& contents)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    bool success = fseek(file, 0, SEEK_END) == 0;
+    long size = success ? ftell(file) : -1;
+    success = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (success)
+    {
+        contents.resize(static_cast<size_t>(size));
+        success = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    }
+    fclose(file);
+    return success;
+}
+
+// Resolves a 1-based or negative (counted back from the end) OBJ index
+// into [0, count); returns false if it is out of range
+bool ObjIndex(long index, size_t count, uint32_t& resolved)
+{
+    long long zeroBased = index < 0 ? static_cast<long long>(count) + index : static_cast<long long>(index) - 1;
+    resolved = static_cast<uint32_t>(zeroBased);
+    return index != 0 && zeroBased >= 0 && zeroBased < static_cast<long long>(count);
+}
+
+// Parses one v, v/vt, v//vn or v/vt/vn face corner; normal is -1 if absent
+bool ObjCorner(const std::string& word, size_t positionCount, size_t normalCount, uint32_t& position, long long& normal)
+{
+    char* cursor = nullptr;
+    long index = strtol(word.c_str(), &cursor, 10);
+    if (cursor == word.c_str() || !ObjIndex(index, positionCount, position))
+    {
+        return false;
+    }
+
+    normal = -1;
+    if (*cursor == '/')
+    {
+        ++cursor;
+        if (*cursor != '/' && *cursor != '\0')
+        {
+            strtol(cursor, &cursor, 10); // Texture coordinates are not used
+        }
+        if (*cursor == '/')
+        {
+            const char* start = ++cursor;
+            uint32_t resolved;
+            index = strtol(start, &cursor, 10);
+            if (cursor == start || !ObjIndex(index, normalCount, resolved))
+            {
+                return false;
+            }
+            normal = resolved;
+        }
+    }
+    return *cursor == '\0';
+}
+
+// Appends the v, vn and f statements of an OBJ file to the scene's mesh
+// arrays, scaled and then offset, with every triangle using material.
+// Polygons are split into fans. Each distinct position and normal pair
+// becomes one vertex; corners without a normal get a zero normal and shade
+// flat. Other statements are ignored. Reports the first error with its line
+// number on stderr and returns false.
+bool LoadObj(Scene& scene, const char* path, float scale, const Vector3& offset, uint16_t material)
+{
+    std::vector<char> contents;
+    if (!ReadFile(path, contents))
+    {
+        fprintf(stderr, "%s: cannot read mesh\n", path);
+        return false;
+    }
+
+    std::vector<Vector3> positions;
+    std::vector<Vector3> normals;
+    std::unordered_map<uint64_t, uint32_t> vertexIndices;
+    std::vector<uint32_t> polygon;
+    std::string keyword;
+    std::string word;
+    scene.vertexNormals.resize(scene.vertices.size(), Vector3(0.0f));
+    const char* lineStart = contents.data();
+    const char* fileEnd = contents.data() + contents.size();
+    for (int lineNumber = 1; lineStart < fileEnd; ++lineNumber)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', fileEnd - lineStart));
+        lineEnd = lineEnd ? lineEnd : fileEnd;
+        LineReader line(lineStart, lineEnd);
+        lineStart = lineEnd + 1;
+
+        if (!line.Word(keyword))
+        {
+            continue;
+        }
+
+        const char* error = nullptr;
+        if (keyword == "v")
+        {
+            // An optional fourth (w) component is ignored
+            Vector3 position;
+            if (!line.Vector(position))
+            {
+                error = "expected v <x> <y> <z>";
+            }
+            else
+            {
+                positions.push_back(position * scale + offset);
+            }
+        }
+        else if (keyword == "vn")
+        {
+            Vector3 normal;
+            if (!line.Vector(normal) || !line.AtEnd())
+            {
+                error = "expected vn <x> <y> <z>";
+            }
+            else
+            {
+                normals.push_back(normal.Dot(normal) > 0.0f ? normal.Normalize() : normal);
+            }
+        }
+        else if (keyword == "f")
+        {
+            polygon.clear();
+            while (!error && line.Word(word))
+            {
+                uint32_t position;
+                long long normal;
+                if (!ObjCorner(word, positions.size(), normals.size(), position, normal))
+                {
+                    error = "bad face corner; expected <v>, <v>/<vt>, <v>//<vn> or <v>/<vt>/<vn> with indices in range";
+                    break;
+                }
+
+                uint64_t key = (static_cast<uint64_t>(position) << 32) | static_cast<uint32_t>(normal + 1);
+                auto inserted = vertexIndices.emplace(key, static_cast<uint32_t>(scene.vertices.size()));
+                if (inserted.second)
+                {
+                    scene.vertices.push_back(positions[position]);
+                    scene.vertexNormals.push_back(normal >= 0 ? normals[static_cast<size_t>(normal)] : Vector3(0.0f));
+                }
+                polygon.push_back(inserted.first->second);
+            }
+            if (!error && polygon.size() < 3)
+            {
+                error = "face has fewer than three corners";
+            }
+            for (size_t i = 2; !error && i < polygon.size(); ++i)
+            {
+                scene.triangles.push_back(Triangle{ { polygon[0], polygon[i - 1], polygon[i] } });
+                scene.triangleMaterials.push_back(material);
+            }
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "%s:%d: %s\n", path, lineNumber, error);
+            return false;
+        }
+    }
+    return true;
+}
+
+// path relative to the directory of the file that names it, unless absolute
+std::string RelativePath(const char* referencingFile, const std::string& path)
+{
+    const char* slash = strrchr(referencingFile, '/');
+#if defined(_WIN32)
+    const char* backslash = strrchr(referencingFile, '\\');
+    slash = backslash && (!slash || backslash > slash) ? backslash : slash;
+    bool absolute = path.size() > 1 && (path[0] == '/' || path[0] == '\\' || path[1] == ':');
+#else
+    bool absolute = !path.empty() && path[0] == '/';
+#endif
+    if (absolute || !slash)
+    {
+        return path;
+    }
+    return std::string(referencingFile, slash + 1) + path;
+}
+
+// Folds a file's size and modification time into hash; returns false if
+// the file cannot be found
+bool HashFileStatus(uint64_t& hash, const char* path)
+{
+    struct stat status;
+    if (stat(path, &status) != 0)
+    {
+        return false;
+    }
+
+    uint64_t size = static_cast<uint64_t>(status.st_size);
+    uint64_t modified = static_cast<uint64_t>(status.st_mtime);
+    hash = HashBytes(hash, &size, sizeof(size));
+    hash = HashBytes(hash, &modified, sizeof(modified));
+    return true;
+}
+
+} // namespace
+
+bool LoadSceneText(Scene& scene, const char* path, int threadCount)
+{
+    ClearScene(scene);
+    std::vector<char> contents;
+    if (!ReadFile(path, contents))
+    {
+        fprintf(stderr, "%s: cannot read scene\n", path);
+        return false;
+    }
+
+    std::unordered_map<std::string, uint16_t> materialIndices;
+    std::string keyword;
+    std::string name;
+    const char* lineStart = contents.data();
+    const char* fileEnd = contents.data() + contents.size();
+    for (int lineNumber = 1; lineStart < fileEnd; ++lineNumber)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', fileEnd - lineStart));
+        lineEnd = lineEnd ? lineEnd : fileEnd;
+        LineReader line(lineStart, lineEnd);
+        lineStart = lineEnd + 1;
+
+        if (!line.Word(keyword) || keyword[0] == '#')
+        {
+            continue;
+        }
+
+        const char* error = nullptr;
+        if (keyword == "material")
+        {
+            Material material;
+            if (!line.Word(name) || !line.Vector(material.color) || !line.Number(material.roughness) || !line.AtEnd())
+            {
+                error = "expected material <name> <r> <g> <b> <roughness>";
+            }
+            else if (scene.materials.size() == Scene::kMaxMaterials)
+            {
+                error = "too many materials";
+            }
+            else if (!materialIndices.emplace(name, static_cast<uint16_t>(scene.materials.size())).second)
+            {
+                error = "material declared twice";
+            }
+            else
+            {
+                scene.materials.push_back(material);
+            }
+        }
+        else if (keyword == "sphere")
+        {
+            Sphere sphere;
+            if (!line.Vector(sphere.center) || !line.Number(sphere.radius) || !line.Word(name) || !line.AtEnd())
+            {
+                error = "expected sphere <x> <y> <z> <radius> <material>";
+            }
+            else if (!(sphere.radius > 0.0f))
+            {
+                error = "sphere radius must be positive";
+            }
+            else
+            {
+                auto material = materialIndices.find(name);
+                if (material == materialIndices.end())
+                {
+                    error = "unknown material";
+                }
+                else
+                {
+                    scene.spheres.push_back(sphere);
+                    scene.sphereMaterials.push_back(material->second);
+                }
+            }
+        }
+        else if (keyword == "mesh")
+        {
+            std::string meshPath;
+            float scale = 1.0f;
+            Vector3 offset(0.0f);
+            bool valid = line.Word(meshPath) && line.Word(name);
+            if (valid && !line.AtEnd())
+            {
+                valid = line.Number(scale) && line.Vector(offset) && line.AtEnd();
+            }
+
+            auto material = materialIndices.find(name);
+            if (!valid)
+            {
+                error = "expected mesh <obj path> <material> [<scale> <x> <y> <z>]";
+            }
+            else if (material == materialIndices.end())
+            {
+                error = "unknown material";
+            }
+            else if (!LoadObj(scene, RelativePath(path, meshPath).c_str(), scale, offset, material->second))
+            {
+                error = "cannot load mesh";
+            }
+        }
+        else if (keyword == "light")
+        {
+            Light light = {};
+            float innerDegrees = 0.0f;
+            float outerDegrees = 0.0f;
+            bool valid = line.Word(name) && line.Vector(light.position) && line.Vector(light.intensity);
+            if (valid && name == "point")
+            {
+                light.type = LightType::Point;
+            }
+            else if (valid && name == "spot")
+            {
+                light.type = LightType::Spot;
+                valid = line.Vector(light.direction) && line.Number(innerDegrees) && line.Number(outerDegrees) &&
+                    light.direction.Dot(light.direction) > 0.0f && innerDegrees < outerDegrees;
+                light.direction = light.direction.Normalize();
+                light.cosInner = cosf(innerDegrees * kPi / 180.0f);
+                light.cosOuter = cosf(outerDegrees * kPi / 180.0f);
+            }
+            else if (valid && name == "sphere")
+            {
+                light.type = LightType::Sphere;
+                valid = line.Number(light.radius) && light.radius > 0.0f;
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid || !line.AtEnd())
+            {
+                error = "expected light point|spot|sphere <x> <y> <z> <r> <g> <b> followed by a direction and inner < outer angles (spot) or a radius (sphere)";
+            }
+            else
+            {
+                scene.lights.push_back(light);
+            }
+        }
+        else
+        {
+            error = "unknown statement";
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "%s:%d: %s\n", path, lineNumber, error);
+            ClearScene(scene);
+            return false;
+        }
+    }
+
+    scene.bvh.Build(scene.spheres, threadCount);
+    scene.triangleBvh.Build(scene.vertices, scene.vertexNormals, scene.triangles, threadCount);
+    scene.lightTree.Build(scene.lights);
+    return true;
+}
+
+uint64_t SceneFileKey(const char* path)
+{
+    uint64_t hash = HashBytes(kHashSeed, "file", 4);
+    std::vector<char> contents;
+    if (!HashFileStatus(hash, path) || !ReadFile(path, contents))
+    {
+        return 0;
+    }
+
+    // The OBJ files of mesh statements are read at load time too, so their
+    // paths, sizes and modification times are part of the key
+    std::string keyword;
+    std::string meshPath;
+    const char* lineStart = contents.data();
+    const char* fileEnd = contents.data() + contents.size();
+    while (lineStart < fileEnd)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(lineStart, '\n', fileEnd - lineStart));
+        lineEnd = lineEnd ? lineEnd : fileEnd;
+        LineReader line(lineStart, lineEnd);
+        lineStart = lineEnd + 1;
+
+        if (line.Word(keyword) && keyword == "mesh" && line.Word(meshPath))
+        {
+            std::string resolved = RelativePath(path, meshPath);
+            hash = HashBytes(hash, resolved.data(), resolved.size());
+            if (!HashFileStatus(hash, resolved.c_str()))
+            {
+                return 0;
+            }
+        }
+    }
+    return hash;
+}
+
+uint64_t GeneratedSceneKey(const char* generator, int sphereCount, int lightCount)
+{
+    uint64_t hash = HashBytes(kHashSeed, generator, strlen(generator));
+    hash = HashBytes(hash, &sphereCount, sizeof(sphereCount));
+    return HashBytes(hash, &lightCount, sizeof(lightCount));
+}
+
+bool SaveSceneCache(const Scene& scene, const char* path, uint64_t sourceKey)
+{
+    SectionData sections[kSectionCount];
+    sections[kMaterials] = Section(scene.materials);
+    sections[kSpheres] = Section(scene.spheres);
+    sections[kSphereMaterials] = Section(scene.sphereMaterials);
+    sections[kLights] = Section(scene.lights);
+    sections[kBvhNodes] = Section(scene.bvh.nodes);
+    sections[kBvhIndices] = Section(scene.bvh.primitiveIndices);
+    sections[kLeafCenterX] = Section(scene.bvh.leafSpheres.centerX);
+    sections[kLeafCenterY] = Section(scene.bvh.leafSpheres.centerY);
+    sections[kLeafCenterZ] = Section(scene.bvh.leafSpheres.centerZ);
+    sections[kLeafRadiusSquared] = Section(scene.bvh.leafSpheres.radiusSquared);
+    sections[kLightNodes] = Section(scene.lightTree.nodes);
+    sections[kVertices] = Section(scene.vertices);
+    sections[kVertexNormals] = Section(scene.vertexNormals);
+    sections[kTriangles] = Section(scene.triangles);
+    sections[kTriangleMaterials] = Section(scene.triangleMaterials);
+    sections[kTriangleNodes] = Section(scene.triangleBvh.nodes);
+    sections[kTriangleIndices] = Section(scene.triangleBvh.primitiveIndices);
+    sections[kLeafV0X] = Section(scene.triangleBvh.leafTriangles.v0X);
+    sections[kLeafV0Y] = Section(scene.triangleBvh.leafTriangles.v0Y);
+    sections[kLeafV0Z] = Section(scene.triangleBvh.leafTriangles.v0Z);
+    sections[kLeafEdge1X] = Section(scene.triangleBvh.leafTriangles.edge1X);
+    sections[kLeafEdge1Y] = Section(scene.triangleBvh.leafTriangles.edge1Y);
+    sections[kLeafEdge1Z] = Section(scene.triangleBvh.leafTriangles.edge1Z);
+    sections[kLeafEdge2X] = Section(scene.triangleBvh.leafTriangles.edge2X);
+    sections[kLeafEdge2Y] = Section(scene.triangleBvh.leafTriangles.edge2Y);
+    sections[kLeafEdge2Z] = Section(scene.triangleBvh.leafTriangles.edge2Z);
+
+    CacheHeader header = {};
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.byteOrder = kByteOrderMark;
+    header.sourceKey = sourceKey;
+    header.bvhBuilder = static_cast<uint32_t>(scene.bvh.stats.builder);
+    header.bvhTreelets = scene.bvh.stats.treelets ? 1 : 0;
+    header.bvhLeafCount = scene.bvh.stats.leafCount;
+    header.bvhMaxDepth = scene.bvh.stats.maxDepth;
+    header.triangleLeafCount = scene.triangleBvh.stats.leafCount;
+    header.triangleMaxDepth = scene.triangleBvh.stats.maxDepth;
+    header.bvhSahCost = scene.bvh.builtSahCost;
+    header.triangleSahCost = scene.triangleBvh.stats.sahCost;
+    uint64_t offset = sizeof(CacheHeader);
+    for (int i = 0; i < kSectionCount; ++i)
+    {
+        offset = (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+        header.sections[i].offset = offset;
+        header.sections[i].count = sections[i].count;
+        header.sections[i].elementSize = sections[i].elementSize;
+        offset += sections[i].count * sections[i].elementSize;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    const char kPadding[kSectionAlignment] = {};
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t written = sizeof(header);
+    for (int i = 0; i < kSectionCount && success; ++i)
+    {
+        size_t padding = static_cast<size_t>(header.sections[i].offset - written);
+        size_t bytes = static_cast<size_t>(sections[i].count * sections[i].elementSize);
+        success = fwrite(kPadding, 1, padding, file) == padding && fwrite(sections[i].data, 1, bytes, file) == bytes;
+        written += padding + bytes;
+    }
+    return fclose(file) == 0 && success;
+}
+
+bool LoadSceneCache(Scene& scene, const char* path, uint64_t sourceKey)
+{
+    ClearScene(scene);
+    MappedFile& file = scene.cacheFile;
+    if (!file.Open(path) || file.Size() < sizeof(CacheHeader))
+    {
+        file.Close();
+        return false;
+    }
+
+    const CacheHeader& header = *reinterpret_cast<const CacheHeader*>(file.Data());
+    Bvh& bvh = scene.bvh;
+    SphereSoA& leafSpheres = bvh.leafSpheres;
+    TriangleBvh& triangleBvh = scene.triangleBvh;
+    TriangleSoA& leafTriangles = triangleBvh.leafTriangles;
+    bool treelets = bvh.builder == BvhBuilder::Morton && bvh.optimizeTreelets;
+    bool valid = memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) == 0 && header.version == kCacheVersion &&
+        header.byteOrder == kByteOrderMark && header.sourceKey == sourceKey &&
+        header.bvhBuilder == static_cast<uint32_t>(bvh.builder) && header.bvhTreelets == (treelets ? 1u : 0u) &&
+        ViewSection(file, header.sections[kMaterials], scene.materials) &&
+        ViewSection(file, header.sections[kSpheres], scene.spheres) &&
+        ViewSection(file, header.sections[kSphereMaterials], scene.sphereMaterials) &&
+        ViewSection(file, header.sections[kLights], scene.lights) &&
+        ViewSection(file, header.sections[kBvhNodes], bvh.nodes) &&
+        ViewSection(file, header.sections[kBvhIndices], bvh.primitiveIndices) &&
+        ViewSection(file, header.sections[kLeafCenterX], leafSpheres.centerX) &&
+        ViewSection(file, header.sections[kLeafCenterY], leafSpheres.centerY) &&
+        ViewSection(file, header.sections[kLeafCenterZ], leafSpheres.centerZ) &&
+        ViewSection(file, header.sections[kLeafRadiusSquared], leafSpheres.radiusSquared) &&
+        ViewSection(file, header.sections[kLightNodes], scene.lightTree.nodes) &&
+        ViewSection(file, header.sections[kVertices], scene.vertices) &&
+        ViewSection(file, header.sections[kVertexNormals], scene.vertexNormals) &&
+        ViewSection(file, header.sections[kTriangles], scene.triangles) &&
+        ViewSection(file, header.sections[kTriangleMaterials], scene.triangleMaterials) &&
+        ViewSection(file, header.sections[kTriangleNodes], triangleBvh.nodes) &&
+        ViewSection(file, header.sections[kTriangleIndices], triangleBvh.primitiveIndices) &&
+        ViewSection(file, header.sections[kLeafV0X], leafTriangles.v0X) &&
+        ViewSection(file, header.sections[kLeafV0Y], leafTriangles.v0Y) &&
+        ViewSection(file, header.sections[kLeafV0Z], leafTriangles.v0Z) &&
+        ViewSection(file, header.sections[kLeafEdge1X], leafTriangles.edge1X) &&
+        ViewSection(file, header.sections[kLeafEdge1Y], leafTriangles.edge1Y) &&
+        ViewSection(file, header.sections[kLeafEdge1Z], leafTriangles.edge1Z) &&
+        ViewSection(file, header.sections[kLeafEdge2X], leafTriangles.edge2X) &&
+        ViewSection(file, header.sections[kLeafEdge2Y], leafTriangles.edge2Y) &&
+        ViewSection(file, header.sections[kLeafEdge2Z], leafTriangles.edge2Z);
+
+    // Shapes the traversal code relies on; element contents are trusted
+    size_t sphereCount = scene.spheres.size();
+    size_t paddedCount = sphereCount + SphereSoA::kWidth;
+    valid = valid && scene.sphereMaterials.size() == sphereCount && bvh.primitiveIndices.size() == sphereCount && bvh.nodes.empty() == (sphereCount == 0) &&
+        leafSpheres.centerX.size() == paddedCount && leafSpheres.centerY.size() == paddedCount &&
+        leafSpheres.centerZ.size() == paddedCount && leafSpheres.radiusSquared.size() == paddedCount &&
+        scene.lightTree.nodes.size() == (scene.lights.empty() ? 0 : 2 * scene.lights.size() - 1);
+
+    size_t triangleCount = scene.triangles.size();
+    size_t paddedTriangleCount = triangleCount + TriangleSoA::kWidth;
+    const Buffer<float>* triangleArrays[] = { &leafTriangles.v0X, &leafTriangles.v0Y, &leafTriangles.v0Z,
+        &leafTriangles.edge1X, &leafTriangles.edge1Y, &leafTriangles.edge1Z, &leafTriangles.edge2X, &leafTriangles.edge2Y, &leafTriangles.edge2Z };
+    valid = valid && (scene.vertexNormals.empty() || scene.vertexNormals.size() == scene.vertices.size()) &&
+        scene.triangleMaterials.size() == triangleCount && triangleBvh.primitiveIndices.size() == triangleCount &&
+        triangleBvh.nodes.empty() == (triangleCount == 0);
+    for (const Buffer<float>* array : triangleArrays)
+    {
+        valid = valid && array->size() == paddedTriangleCount;
+    }
+    if (!valid)
+    {
+        ClearScene(scene);
+        return false;
+    }
+
+    leafSpheres.count = static_cast<uint32_t>(sphereCount);
+    bvh.spheres = &scene.spheres;
+    bvh.stats = BvhStats();
+    bvh.stats.width = WideBvhNode::kWidth;
+    bvh.stats.builder = bvh.builder;
+    bvh.stats.treelets = treelets;
+    bvh.stats.nodeCount = static_cast<uint32_t>(bvh.nodes.size());
+    bvh.stats.leafCount = header.bvhLeafCount;
+    bvh.stats.maxDepth = header.bvhMaxDepth;
+    bvh.stats.sahCost = header.bvhSahCost;
+    bvh.builtSahCost = header.bvhSahCost;
+    bvh.stats.memoryBytes = bvh.MemoryBytes();
+
+    leafTriangles.count = static_cast<uint32_t>(triangleCount);
+    triangleBvh.vertices = &scene.vertices;
+    triangleBvh.normals = &scene.vertexNormals;
+    triangleBvh.triangles = &scene.triangles;
+    triangleBvh.stats = BvhStats();
+    triangleBvh.stats.nodeCount = static_cast<uint32_t>(triangleBvh.nodes.size());
+    triangleBvh.stats.leafCount = header.triangleLeafCount;
+    triangleBvh.stats.maxDepth = header.triangleMaxDepth;
+    triangleBvh.stats.sahCost = header.triangleSahCost;
+    triangleBvh.stats.memoryBytes = triangleBvh.MemoryBytes();
+    return true;
+}
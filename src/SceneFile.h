@@ -0,0 +1,45 @@
+// SceneFile.h
+//
+// Text scene descriptions and the binary scene cache. A text scene has one
+// statement per line; blank lines and lines starting with # are ignored:
+//   material <name> <r> <g> <b> <roughness>
+//   sphere <x> <y> <z> <radius> <material name>
+//   mesh <obj path> <material name> [<scale> <x> <y> <z>]
+//   light point <x> <y> <z> <r> <g> <b>
+//   light spot <x> <y> <z> <r> <g> <b> <dx> <dy> <dz> <inner degrees> <outer degrees>
+//   light sphere <x> <y> <z> <r> <g> <b> <radius>
+// Light colours are radiant intensities (see Light). Materials must be
+// declared before the spheres and meshes that use them. A mesh statement
+// loads the positions, normals and faces of a Wavefront OBJ file, relative
+// to the scene file unless absolute, scales them and then moves them by
+// <x> <y> <z>; every triangle uses the one material.
+//
+// The cache holds a built scene, hierarchies included, as a flat native
+// layout. Loading maps it and points the scene's arrays into the mapping,
+// so nothing is parsed, built or copied and pages load as rays touch them.
+
+#pragma once
+
+#include "Scene.h"
+#include <cstdint>
+
+// Parses a text scene into scene and builds its hierarchies on threadCount
+// threads (0 uses all of them). Reports the first error with its line
+// number on stderr and returns false.
+bool LoadSceneText(Scene& scene, const char* path, int threadCount = 0);
+
+// Identify the source a cache was built from, so a stale cache is rebuilt.
+// A text scene is identified by its size and modification time and those
+// of the OBJ files its mesh statements name (0 if any cannot be read); a
+// generated scene by its generator's name and counts.
+uint64_t SceneFileKey(const char* path);
+uint64_t GeneratedSceneKey(const char* generator, int sphereCount, int lightCount);
+
+bool SaveSceneCache(const Scene& scene, const char* path, uint64_t sourceKey);
+
+// Maps a cache written by SaveSceneCache for the same source key and by a
+// build with the same data layout, whose sphere hierarchy was built with
+// scene.bvh's builder and treelet setting. Returns false, leaving the scene
+// empty, if the cache is missing, stale, from an incompatible build or from
+// another builder.
+bool LoadSceneCache(Scene& scene, const char* path, uint64_t sourceKey);
@@ -0,0 +1,97 @@
+// Simd.h
+//
+// Thin wrappers so one kernel body serves every instruction set. Masks are
+// full-width lane values; MoveMask packs their sign bits into an int.
+// SOFTRT_SIMD is defined when a vector instruction set is available.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SOFTRT_SIMD
+#define SOFTRT_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTRT_SIMD
+#define SOFTRT_SIMD_SSE2
+#endif
+
+namespace Simd
+{
+
+#if defined(SOFTRT_SIMD_AVX2)
+
+typedef __m256 Lanes;
+const uint32_t kLanes = 8;
+const char* const kSimdName = "AVX2";
+
+inline Lanes Set1(float value) { return _mm256_set1_ps(value); }
+inline Lanes SetBits(uint32_t bits) { return _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(bits))); }
+inline Lanes Load(const float* data) { return _mm256_loadu_ps(data); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+inline Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+inline Lanes Sqrt(Lanes a) { return _mm256_sqrt_ps(a); }
+inline Lanes MinLanes(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+inline Lanes MaxLanes(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+inline Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+inline Lanes Or(Lanes a, Lanes b) { return _mm256_or_ps(a, b); }
+inline Lanes CmpGe(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline Lanes CmpLe(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+inline Lanes CmpGt(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+inline int MoveMask(Lanes mask) { return _mm256_movemask_ps(mask); }
+inline void Store(float* data, Lanes a) { _mm256_storeu_ps(data, a); }
+
+// kLanes unsigned bytes widened to floats
+inline Lanes LoadBytes(const uint8_t* data)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))));
+}
+
+#elif defined(SOFTRT_SIMD_SSE2)
+
+typedef __m128 Lanes;
+const uint32_t kLanes = 4;
+const char* const kSimdName = "SSE2";
+
+inline Lanes Set1(float value) { return _mm_set1_ps(value); }
+inline Lanes SetBits(uint32_t bits) { return _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(bits))); }
+inline Lanes Load(const float* data) { return _mm_loadu_ps(data); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+inline Lanes MinLanes(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+inline Lanes MaxLanes(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+inline Lanes Or(Lanes a, Lanes b) { return _mm_or_ps(a, b); }
+inline Lanes CmpGe(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+inline Lanes CmpLe(Lanes a, Lanes b) { return _mm_cmple_ps(a, b); }
+inline Lanes CmpGt(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline int MoveMask(Lanes mask) { return _mm_movemask_ps(mask); }
+inline void Store(float* data, Lanes a) { _mm_storeu_ps(data, a); }
+
+inline Lanes LoadBytes(const uint8_t* data)
+{
+    int32_t bytes;
+    memcpy(&bytes, data, sizeof(bytes));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+
+#else
+
+const uint32_t kLanes = 1;
+const char* const kSimdName = "scalar";
+
+#endif
+
+} // namespace Simd
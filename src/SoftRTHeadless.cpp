@@ -0,0 +1,313 @@
+// SoftRTHeadless.cpp
+//
+// Renders without a window and writes the result to disk. Usage:
+//   SoftRTHeadless [--width N] [--height N] [--scene file] [--scene-cache file] [--spheres N] [--point-cloud] [--lights N] [--light-samples N] [--threads N] [--tile N] [--passes N] [--no-packets] [--wavefront] [--noise-threshold T] [--min-samples N] [--max-bounces N] [--roulette-bounces N] [--sample-bounces] [--denoise] [--frames N] [--frame-time S] [--rebuild-ratio R] [--builder sah|morton] [--treelets] [--camera X,Y,Z] [--camera-move X,Y,Z] [--temporal] [--output file.png|file.ppm]
+
+#include "Denoiser.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "Temporal.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    int width = 1024;
+    int height = 1024;
+    int sphereCount = 40;
+    bool pointCloud = false;
+    int lightCount = 0;
+    int passCount = 1;
+    bool denoise = false;
+    int frameCount = 1;
+    float frameTime = 1.0f / 30.0f;
+    float rebuildRatio = 1.5f;
+    BvhBuilder builder = BvhBuilder::Sah;
+    bool optimizeTreelets = false;
+    Vector3 cameraMove(0.0f);
+    bool temporal = false;
+    const char* scenePath = nullptr;
+    const char* sceneCachePath = nullptr;
+    const char* outputPath = "SoftRT.png";
+    RenderSettings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--width") == 0 && hasValue)
+        {
+            width = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--height") == 0 && hasValue)
+        {
+            height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--scene") == 0 && hasValue)
+        {
+            scenePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scene-cache") == 0 && hasValue)
+        {
+            sceneCachePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--spheres") == 0 && hasValue)
+        {
+            sphereCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--point-cloud") == 0)
+        {
+            pointCloud = true;
+        }
+        else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+        {
+            lightCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--light-samples") == 0 && hasValue)
+        {
+            settings.lightSamples = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+        {
+            settings.threadCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tile") == 0 && hasValue)
+        {
+            settings.tileSize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--passes") == 0 && hasValue)
+        {
+            passCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-packets") == 0)
+        {
+            settings.usePackets = false;
+        }
+        else if (strcmp(argv[i], "--wavefront") == 0)
+        {
+            settings.useWavefront = true;
+        }
+        else if (strcmp(argv[i], "--noise-threshold") == 0 && hasValue)
+        {
+            settings.noiseThreshold = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--min-samples") == 0 && hasValue)
+        {
+            settings.minSamples = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-bounces") == 0 && hasValue)
+        {
+            settings.maxBounces = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--roulette-bounces") == 0 && hasValue)
+        {
+            settings.rouletteMinBounces = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sample-bounces") == 0)
+        {
+            settings.sampleBounces = true;
+        }
+        else if (strcmp(argv[i], "--denoise") == 0)
+        {
+            denoise = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+        {
+            frameCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frame-time") == 0 && hasValue)
+        {
+            frameTime = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--rebuild-ratio") == 0 && hasValue)
+        {
+            rebuildRatio = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--builder") == 0 && hasValue && (strcmp(argv[i + 1], "sah") == 0 || strcmp(argv[i + 1], "morton") == 0))
+        {
+            builder = strcmp(argv[++i], "morton") == 0 ? BvhBuilder::Morton : BvhBuilder::Sah;
+        }
+        else if (strcmp(argv[i], "--treelets") == 0)
+        {
+            optimizeTreelets = true;
+        }
+        else if (strcmp(argv[i], "--camera") == 0 && hasValue
+            && sscanf(argv[i + 1], "%f,%f,%f", &settings.cameraPosition.x, &settings.cameraPosition.y, &settings.cameraPosition.z) == 3)
+        {
+            ++i;
+        }
+        else if (strcmp(argv[i], "--camera-move") == 0 && hasValue && sscanf(argv[i + 1], "%f,%f,%f", &cameraMove.x, &cameraMove.y, &cameraMove.z) == 3)
+        {
+            ++i;
+        }
+        else if (strcmp(argv[i], "--temporal") == 0)
+        {
+            temporal = true;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+        {
+            outputPath = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--width N] [--height N] [--scene file] [--scene-cache file] [--spheres N] [--point-cloud] [--lights N] [--light-samples N] [--threads N] [--tile N] [--passes N] [--no-packets] [--wavefront] [--noise-threshold T] [--min-samples N] [--max-bounces N] [--roulette-bounces N] [--sample-bounces] [--denoise] [--frames N] [--frame-time S] [--rebuild-ratio R] [--builder sah|morton] [--treelets] [--camera X,Y,Z] [--camera-move X,Y,Z] [--temporal] [--output file.png|file.ppm]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (width <= 0 || height <= 0 || sphereCount < 0 || lightCount < 0 || passCount <= 0 || frameCount <= 0)
+    {
+        fprintf(stderr, "Invalid resolution %dx%d, sphere count %d, light count %d, pass count %d or frame count %d\n", width, height, sphereCount, lightCount, passCount, frameCount);
+        return 1;
+    }
+
+    // Reprojection needs the scene to stand still, so --temporal keeps the
+    // spheres in place whatever --frame-time says
+    if (temporal)
+    {
+        frameTime = 0.0f;
+    }
+
+    // A valid cache for the same builder replaces parsing and building;
+    // otherwise it is rewritten from the freshly built scene
+    auto sceneStart = std::chrono::steady_clock::now();
+    Scene scene;
+    scene.bvh.builder = builder;
+    scene.bvh.optimizeTreelets = optimizeTreelets;
+    const char* generator = pointCloud ? "point-cloud" : "default";
+    uint64_t sourceKey = scenePath ? SceneFileKey(scenePath) : GeneratedSceneKey(generator, sphereCount, lightCount);
+    bool cached = sceneCachePath && LoadSceneCache(scene, sceneCachePath, sourceKey);
+    if (!cached)
+    {
+        if (scenePath && !LoadSceneText(scene, scenePath, settings.threadCount))
+        {
+            return 1;
+        }
+        if (!scenePath)
+        {
+            if (pointCloud)
+            {
+                BuildPointCloudScene(scene, sphereCount, lightCount, settings.threadCount);
+            }
+            else
+            {
+                BuildDefaultScene(scene, sphereCount, lightCount, settings.threadCount);
+            }
+        }
+        if (sceneCachePath && !SaveSceneCache(scene, sceneCachePath, sourceKey))
+        {
+            fprintf(stderr, "Failed to write %s\n", sceneCachePath);
+            return 1;
+        }
+    }
+    printf("Scene: %zu spheres, %zu triangles, %zu materials, %zu lights, %s in %.2f ms\n", scene.spheres.size(), scene.triangles.size(),
+        scene.materials.size(), scene.lights.size(), cached ? "mapped from cache" : "built", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sceneStart).count());
+    PrintBvhStats(scene.bvh.stats);
+    if (!scene.triangles.empty())
+    {
+        PrintBvhStats(scene.triangleBvh.stats);
+    }
+    PrintSceneMemory(scene);
+
+    Framebuffer framebuffer(width, height);
+    AccumulationBuffer accumulation(width, height);
+    Framebuffer denoised(width, height);
+    if (denoise || temporal)
+    {
+        accumulation.EnableFeatures();
+    }
+
+    // Frames after the first animate the spheres and refit the hierarchy,
+    // rebuilding it only once the refit tree has degraded too far, and move
+    // the camera. With --temporal the spheres stand still and the image is
+    // carried over to the new view instead of starting again.
+    SphereAnimation animation;
+    animation.Capture(scene);
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        if (frame > 0 && frameTime > 0.0f)
+        {
+            animation.Apply(scene, static_cast<float>(frame) * frameTime, settings.threadCount);
+            float builtSahCost = scene.bvh.builtSahCost;
+            bool rebuilt = scene.bvh.Update(settings.threadCount, rebuildRatio);
+            const BvhStats& stats = scene.bvh.stats;
+            printf("Frame %d: refit in %.2f ms, SAH cost %.1f (%.2fx built)", frame, stats.refitMs, stats.refitSahCost,
+                builtSahCost > 0.0f ? stats.refitSahCost / builtSahCost : 0.0f);
+            if (rebuilt)
+            {
+                printf(", rebuilt in %.2f ms (SAH cost %.1f)", stats.buildMs, stats.sahCost);
+            }
+            printf("\n");
+        }
+        if (frame > 0)
+        {
+            Vector3 previousCamera = settings.cameraPosition;
+            settings.cameraPosition = settings.cameraPosition + cameraMove;
+            if (temporal)
+            {
+                TemporalSettings temporalSettings;
+                temporalSettings.threadCount = settings.threadCount;
+                auto start = std::chrono::steady_clock::now();
+                uint32_t reusedCount = Reproject(accumulation, framebuffer, previousCamera, settings.cameraPosition, temporalSettings);
+                auto end = std::chrono::steady_clock::now();
+                printf("Frame %d: reprojected %u of %d pixels (%.1f%%) in %.2f ms\n", frame, reusedCount, width * height,
+                    100.0 * reusedCount / (static_cast<double>(width) * height), std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            else
+            {
+                accumulation.Reset();
+            }
+        }
+
+        // The image on disk is refreshed after every pass so it can be viewed
+        // while refinement continues
+        double totalMs = 0.0;
+        for (int pass = 0; pass < passCount; ++pass)
+        {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t rayCount = RenderPass(scene, accumulation, framebuffer, settings);
+            auto end = std::chrono::steady_clock::now();
+
+            double renderMs = std::chrono::duration<double, std::milli>(end - start).count();
+            totalMs += renderMs;
+            printf("Rendered %dx%d in %.2f ms (%u spp, %.2f ms total, %.2f Mrays/s)\n",
+                width, height, renderMs, accumulation.sampleCount, totalMs, rayCount / (renderMs * 1000.0));
+
+            // Adaptive sampling may finish before the pass budget runs out
+            bool converged = rayCount == 0;
+            if (settings.noiseThreshold > 0.0f && (converged || pass + 1 == passCount))
+            {
+                printf("Adaptive sampling: %.2f samples per pixel on average%s\n",
+                    static_cast<double>(accumulation.TotalSamples()) / (static_cast<double>(width) * height),
+                    converged ? ", every pixel converged" : "");
+            }
+
+            // Only the final image is denoised
+            const Framebuffer* image = &framebuffer;
+            if (denoise && (converged || pass + 1 == passCount))
+            {
+                DenoiseSettings denoiseSettings;
+                denoiseSettings.threadCount = settings.threadCount;
+                start = std::chrono::steady_clock::now();
+                Denoise(accumulation, denoised, denoiseSettings);
+                end = std::chrono::steady_clock::now();
+                printf("Denoised in %.2f ms\n", std::chrono::duration<double, std::milli>(end - start).count());
+                image = &denoised;
+            }
+
+            if (!WriteImage(*image, outputPath))
+            {
+                fprintf(stderr, "Failed to write %s\n", outputPath);
+                return 1;
+            }
+
+            if (converged)
+            {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+// SphereSoA.cpp
+
+#include "SphereSoA.h"
+#include "Intersect.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace Simd;
+
+namespace
+{
+
+// Spheres copied per thread pool task
+const uint32_t kCopyChunkSize = 1 << 16;
+
+} // namespace
+
+void SphereSoA::Build(const Buffer<Sphere>& spheres, const Buffer<uint32_t>* order, int threadCount)
+{
+    count = static_cast<uint32_t>(spheres.size());
+    size_t paddedCount = count + kWidth;
+    centerX.assign(paddedCount, 0.0f);
+    centerY.assign(paddedCount, 0.0f);
+    centerZ.assign(paddedCount, 0.0f);
+    radiusSquared.assign(paddedCount, 0.0f);
+
+    uint32_t chunkCount = (count + kCopyChunkSize - 1) / kCopyChunkSize;
+    SharedThreadPool(threadCount).ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint32_t first = chunk * kCopyChunkSize;
+        uint32_t last = std::min(first + kCopyChunkSize, count);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            const Sphere& sphere = spheres[order ? (*order)[i] : i];
+            centerX[i] = sphere.center.x;
+            centerY[i] = sphere.center.y;
+            centerZ[i] = sphere.center.z;
+            radiusSquared[i] = sphere.radius * sphere.radius;
+        }
+    });
+}
+
+const char* SphereKernelName()
+{
+    return kSimdName;
+}
+
+#if defined(SOFTRT_SIMD)
+
+int IntersectNearest(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax)
+{
+    const Lanes originX = Set1(ray.origin.x);
+    const Lanes originY = Set1(ray.origin.y);
+    const Lanes originZ = Set1(ray.origin.z);
+    const Lanes directionX = Set1(ray.direction.x);
+    const Lanes directionY = Set1(ray.direction.y);
+    const Lanes directionZ = Set1(ray.direction.z);
+    const Lanes a = Set1(ray.direction.Dot(ray.direction));
+    const Lanes zero = Set1(0.0f);
+    const Lanes minT = Set1(tMin);
+
+    int nearest = -1;
+    for (uint32_t i = 0; i < count; i += kLanes)
+    {
+        uint32_t base = first + i;
+        Lanes ocX = Sub(originX, Load(&spheres.centerX[base]));
+        Lanes ocY = Sub(originY, Load(&spheres.centerY[base]));
+        Lanes ocZ = Sub(originZ, Load(&spheres.centerZ[base]));
+        Lanes halfB = Add(Add(Mul(directionX, ocX), Mul(directionY, ocY)), Mul(directionZ, ocZ));
+        Lanes c = Sub(Add(Add(Mul(ocX, ocX), Mul(ocY, ocY)), Mul(ocZ, ocZ)), Load(&spheres.radiusSquared[base]));
+        Lanes discriminant = Sub(Mul(halfB, halfB), Mul(a, c));
+
+        // Near root unless it lies before tMin, as in the scalar Intersect()
+        Lanes sqrtDiscriminant = Sqrt(MaxLanes(discriminant, zero));
+        Lanes tNear = Div(Sub(zero, Add(halfB, sqrtDiscriminant)), a);
+        Lanes tFar = Div(Sub(sqrtDiscriminant, halfB), a);
+        Lanes t = Select(CmpGe(tNear, minT), tNear, tFar);
+
+        Lanes valid = And(CmpGe(discriminant, zero), And(CmpGe(t, minT), CmpLe(t, Set1(tMax))));
+        int mask = MoveMask(valid);
+        if (count - i < kLanes)
+        {
+            mask &= (1 << (count - i)) - 1;
+        }
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        float laneT[kLanes];
+        Store(laneT, t);
+        for (uint32_t lane = 0; lane < kLanes; ++lane)
+        {
+            if ((mask & (1 << lane)) && laneT[lane] <= tMax)
+            {
+                tMax = laneT[lane];
+                nearest = static_cast<int>(base + lane);
+            }
+        }
+    }
+    return nearest;
+}
+
+bool IntersectAnyWide(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax, bool cullBehindOrigin)
+{
+    const Lanes originX = Set1(ray.origin.x);
+    const Lanes originY = Set1(ray.origin.y);
+    const Lanes originZ = Set1(ray.origin.z);
+    const Lanes directionX = Set1(ray.direction.x);
+    const Lanes directionY = Set1(ray.direction.y);
+    const Lanes directionZ = Set1(ray.direction.z);
+    const Lanes a = Set1(ray.direction.Dot(ray.direction));
+    const Lanes zero = Set1(0.0f);
+    const Lanes minT = Set1(tMin);
+    const Lanes maxT = Set1(tMax);
+
+    for (uint32_t i = 0; i < count; i += kLanes)
+    {
+        uint32_t base = first + i;
+        Lanes ocX = Sub(originX, Load(&spheres.centerX[base]));
+        Lanes ocY = Sub(originY, Load(&spheres.centerY[base]));
+        Lanes ocZ = Sub(originZ, Load(&spheres.centerZ[base]));
+        Lanes halfB = Add(Add(Mul(directionX, ocX), Mul(directionY, ocY)), Mul(directionZ, ocZ));
+        Lanes c = Sub(Add(Add(Mul(ocX, ocX), Mul(ocY, ocY)), Mul(ocZ, ocZ)), Load(&spheres.radiusSquared[base]));
+        Lanes discriminant = Sub(Mul(halfB, halfB), Mul(a, c));
+
+        Lanes valid = CmpGe(discriminant, zero);
+        if (cullBehindOrigin)
+        {
+            // Outside the sphere and moving away from its center
+            valid = And(valid, Or(CmpLe(c, zero), CmpLe(halfB, zero)));
+        }
+
+        Lanes sqrtDiscriminant = Sqrt(MaxLanes(discriminant, zero));
+        Lanes tNear = Div(Sub(zero, Add(halfB, sqrtDiscriminant)), a);
+        Lanes tFar = Div(Sub(sqrtDiscriminant, halfB), a);
+        valid = And(valid, And(CmpLe(tNear, maxT), CmpGe(tFar, minT)));
+
+        int mask = MoveMask(valid);
+        if (count - i < kLanes)
+        {
+            mask &= (1 << (count - i)) - 1;
+        }
+        if (mask != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#else
+
+int IntersectNearest(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax)
+{
+    int nearest = -1;
+    HitRecord hit;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        Sphere sphere{ { spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i] }, sqrtf(spheres.radiusSquared[i]) };
+        if (Intersect(ray, sphere, tMin, tMax, hit))
+        {
+            tMax = hit.t;
+            nearest = static_cast<int>(i);
+        }
+    }
+    return nearest;
+}
+
+bool IntersectAnyWide(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax, bool cullBehindOrigin)
+{
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        Sphere sphere{ { spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i] }, sqrtf(spheres.radiusSquared[i]) };
+        if (IntersectAny(ray, sphere, tMin, tMax, cullBehindOrigin))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,40 @@
+// SphereSoA.h
+
+#pragma once
+
+#include "Buffer.h"
+#include "Geometry.h"
+#include <cstdint>
+
+// Structure-of-arrays copy of a sphere list for the wide intersection
+// kernels. Arrays are padded by one SIMD width so a kernel may load a full
+// register starting at any valid index; padded lanes are masked off.
+class SphereSoA
+{
+public:
+    static const uint32_t kWidth = 8;
+
+    // Copies spheres in the given order (identity when order is null)
+    void Build(const Buffer<Sphere>& spheres, const Buffer<uint32_t>* order = nullptr, int threadCount = 0);
+
+    size_t MemoryBytes() const
+    {
+        return (centerX.size() + centerY.size() + centerZ.size() + radiusSquared.size()) * sizeof(float);
+    }
+
+    uint32_t      count = 0;
+    Buffer<float> centerX;
+    Buffer<float> centerY;
+    Buffer<float> centerZ;
+    Buffer<float> radiusSquared;
+};
+
+// Nearest sphere in [first, first + count) hit within [tMin, tMax]. Returns
+// its index and narrows tMax to its distance, or returns -1.
+int IntersectNearest(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float& tMax);
+
+// True if any sphere in [first, first + count) overlaps [tMin, tMax]
+bool IntersectAnyWide(const SphereSoA& spheres, uint32_t first, uint32_t count, const Ray& ray, float tMin, float tMax, bool cullBehindOrigin);
+
+// Name of the kernel compiled in ("AVX2", "SSE2" or "scalar")
+const char* SphereKernelName();
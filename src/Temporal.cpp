@@ -0,0 +1,186 @@
+// Temporal.cpp
+
+#include "Temporal.h"
+#include "PathTracer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace
+{
+
+// Rows per thread pool task
+const int kBandHeight = 16;
+
+const uint32_t kNoPixel = UINT32_MAX;
+
+} // namespace
+
+uint32_t Reproject(AccumulationBuffer& accumulation, Framebuffer& framebuffer, const Vector3& previousCamera, const Vector3& camera, const TemporalSettings& settings)
+{
+    if (!accumulation.HasFeatures())
+    {
+        accumulation.EnableFeatures();
+        accumulation.Reset();
+        return 0;
+    }
+
+    int width = accumulation.width;
+    int height = accumulation.height;
+    size_t pixelCount = accumulation.sums.size();
+    ThreadPool& pool = SharedThreadPool(settings.threadCount);
+    uint32_t bandCount = static_cast<uint32_t>((height + kBandHeight - 1) / kBandHeight);
+    auto forEachBand = [&](const std::function<void(int y0, int y1)>& body)
+    {
+        pool.ParallelFor(bandCount, [&](uint32_t band, int)
+        {
+            int y0 = static_cast<int>(band) * kBandHeight;
+            body(y0, std::min(y0 + kBandHeight, height));
+        });
+    };
+
+    // Where each pixel's mean first hit lands in the new view, and how far
+    // it is from the new camera. The ray through where the pixel's samples
+    // are centred stands in for them: new samples are centred on the pixel,
+    // reprojected ones where they landed. Landing positions are kept so the
+    // image does not drift a fraction of a pixel with every reprojection.
+    std::vector<uint32_t> targets(pixelCount, kNoPixel);
+    std::vector<float> depths(pixelCount);
+    std::vector<PixelHistory> landings(pixelCount);
+    float dx = 2.0f / static_cast<float>(width);
+    float dy = 2.0f / static_cast<float>(height);
+    forEachBand([&](int y0, int y1)
+    {
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t index = static_cast<size_t>(y) * width + x;
+                uint32_t count = accumulation.counts[index];
+                if (count == 0)
+                {
+                    continue;
+                }
+
+                float centreX = static_cast<float>(x) + 0.5f;
+                float centreY = static_cast<float>(y) + 0.5f;
+                if (!accumulation.history.empty())
+                {
+                    const PixelHistory& history = accumulation.history[index];
+                    float weight = static_cast<float>(std::min(history.count, count)) / static_cast<float>(count);
+                    centreX += history.offsetX * weight;
+                    centreY += history.offsetY * weight;
+                }
+
+                float depth = accumulation.depthSums[index] / static_cast<float>(count);
+                Vector3 direction{ -1.0f + dx * centreX, 1.0f - dy * centreY, kWindowDistance };
+                Vector3 relative = previousCamera + direction.Normalize() * depth - camera;
+                if (relative.z <= 0.0f)
+                {
+                    continue;
+                }
+
+                float column = (relative.x / relative.z * kWindowDistance + 1.0f) / dx;
+                float row = (1.0f - relative.y / relative.z * kWindowDistance) / dy;
+                if (column >= 0.0f && row >= 0.0f && column < static_cast<float>(width) && row < static_cast<float>(height))
+                {
+                    targets[index] = static_cast<uint32_t>(row) * static_cast<uint32_t>(width) + static_cast<uint32_t>(column);
+                    depths[index] = relative.Length();
+                    landings[index].offsetX = column - floorf(column) - 0.5f;
+                    landings[index].offsetY = row - floorf(row) - 0.5f;
+                }
+            }
+        }
+    });
+
+    // Nearest source per pixel, in a fixed order so ties always resolve the
+    // same way
+    std::vector<uint32_t> sources(pixelCount, kNoPixel);
+    for (uint32_t index = 0; index < static_cast<uint32_t>(pixelCount); ++index)
+    {
+        uint32_t target = targets[index];
+        if (target != kNoPixel && (sources[target] == kNoPixel || depths[index] < depths[sources[target]]))
+        {
+            sources[target] = index;
+        }
+    }
+
+    std::vector<Vector3> previousSums(pixelCount, Vector3(0.0f));
+    std::vector<float> previousSumSquares(pixelCount, 0.0f);
+    std::vector<uint32_t> previousCounts(pixelCount, 0);
+    std::vector<Vector3> previousAlbedoSums(pixelCount, Vector3(0.0f));
+    std::vector<Vector3> previousNormalSums(pixelCount, Vector3(0.0f));
+    std::vector<float> previousDepthSums(pixelCount, 0.0f);
+    previousSums.swap(accumulation.sums);
+    previousSumSquares.swap(accumulation.sumSquares);
+    previousCounts.swap(accumulation.counts);
+    previousAlbedoSums.swap(accumulation.albedoSums);
+    previousNormalSums.swap(accumulation.normalSums);
+    previousDepthSums.swap(accumulation.depthSums);
+    accumulation.reused.assign(pixelCount, 0);
+    accumulation.history.assign(pixelCount, PixelHistory());
+
+    uint32_t historySamples = static_cast<uint32_t>(std::max(settings.historySamples, 1));
+    std::atomic<uint32_t> reusedCount(0);
+    forEachBand([&](int y0, int y1)
+    {
+        uint32_t bandReusedCount = 0;
+        for (int y = y0; y < y1; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                size_t index = static_cast<size_t>(y) * width + x;
+                uint32_t source = sources[index];
+                if (source == kNoPixel)
+                {
+                    continue;
+                }
+
+                // A one pixel crack between spread-out foreground pixels
+                // lets a hidden background pixel through: it is deeper than
+                // the neighbours on both sides along some direction, which
+                // no surface seen flat on is
+                float depth = depths[source];
+                float deeper = 1.0f + settings.depthTolerance;
+                auto nearer = [&](int nx, int ny)
+                {
+                    if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                    {
+                        return false;
+                    }
+                    uint32_t neighbour = sources[static_cast<size_t>(ny) * width + nx];
+                    return neighbour != kNoPixel && depth > depths[neighbour] * deeper;
+                };
+                const int kDirections[4][2] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 } };
+                bool crack = false;
+                for (const auto& direction : kDirections)
+                {
+                    crack = crack || (nearer(x - direction[0], y - direction[1]) && nearer(x + direction[0], y + direction[1]));
+                }
+                if (crack)
+                {
+                    continue;
+                }
+
+                uint32_t count = previousCounts[source];
+                uint32_t kept = std::min(count, historySamples);
+                float scale = static_cast<float>(kept) / static_cast<float>(count);
+                accumulation.sums[index] = previousSums[source] * scale;
+                accumulation.sumSquares[index] = previousSumSquares[source] * scale;
+                accumulation.counts[index] = kept;
+                accumulation.albedoSums[index] = previousAlbedoSums[source] * scale;
+                accumulation.normalSums[index] = previousNormalSums[source] * scale;
+                accumulation.depthSums[index] = depth * static_cast<float>(kept);
+                accumulation.reused[index] = 1;
+                accumulation.history[index] = landings[source];
+                accumulation.history[index].count = kept;
+                framebuffer.SetPixel(x, y, previousSums[source] * (1.0f / static_cast<float>(count)));
+                ++bandReusedCount;
+            }
+        }
+        reusedCount += bandReusedCount;
+    });
+    return reusedCount;
+}
@@ -0,0 +1,31 @@
+// Temporal.h
+
+#pragma once
+
+#include "Framebuffer.h"
+
+class TemporalSettings
+{
+public:
+    int   historySamples = 16;    // Samples a reprojected pixel keeps at most, so new ones still count
+    float depthTolerance = 0.05f; // Relative depth step to the neighbours beyond which a pixel is retraced
+    int   threadCount = 0;        // 0 uses every hardware thread
+};
+
+// Temporal reuse for a moving camera. Every pixel's accumulated samples
+// move from the view at previousCamera to wherever its first hit, at the
+// mean depth recorded with the denoiser features, lands in the view at
+// camera; where several land on one pixel the nearest wins. Their average
+// is written to framebuffer and the pixel is marked reused, so the next
+// pass skips it; later passes keep adding samples, blended with at most
+// historySamples of history.
+//
+// Pixels that nothing lands on were disoccluded. Pixels much deeper than
+// their neighbours on both sides may be background showing through a crack
+// between spread-out foreground pixels. Both start empty, so the next pass
+// traces them.
+//
+// The scene must not have changed; Reset() instead when it has. Turns on
+// the features and resets if they were off. Returns the number of pixels
+// that kept their history.
+uint32_t Reproject(AccumulationBuffer& accumulation, Framebuffer& framebuffer, const Vector3& previousCamera, const Vector3& camera, const TemporalSettings& settings = TemporalSettings());
@@ -0,0 +1,156 @@
+// ThreadPool.cpp
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = static_cast<int>(std::thread::hardware_concurrency());
+        threadCount = threadCount > 0 ? threadCount : 1;
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        queues.emplace_back(new WorkQueue);
+    }
+
+    // Thread 0 is whoever calls ParallelFor
+    for (int i = 1; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ThreadPool::WorkerMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t taskCount, const Task& task)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    // Published to workers through the queue mutexes
+    currentTask = &task;
+
+    uint32_t threadCount = static_cast<uint32_t>(queues.size());
+    for (uint32_t thread = 0; thread < threadCount; ++thread)
+    {
+        uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(taskCount) * thread / threadCount);
+        uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(taskCount) * (thread + 1) / threadCount);
+
+        std::lock_guard<std::mutex> lock(queues[thread]->mutex);
+        for (uint32_t taskIndex = first; taskIndex < last; ++taskIndex)
+        {
+            queues[thread]->tasks.push_back(taskIndex);
+        }
+    }
+
+    if (!workers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++generation;
+        }
+        wake.notify_all();
+    }
+
+    RunTasks(0);
+
+    // Queues are drained; wait for tasks still running on other threads
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return activeWorkers == 0; });
+}
+
+void ThreadPool::WorkerMain(int threadIndex)
+{
+    uint64_t seenGeneration = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seenGeneration; });
+            if (stop)
+            {
+                return;
+            }
+            seenGeneration = generation;
+            ++activeWorkers;
+        }
+
+        RunTasks(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--activeWorkers == 0)
+            {
+                done.notify_all();
+            }
+        }
+    }
+}
+
+void ThreadPool::RunTasks(int threadIndex)
+{
+    uint32_t taskIndex;
+    while (PopLocal(threadIndex, taskIndex) || Steal(threadIndex, taskIndex))
+    {
+        (*currentTask)(taskIndex, threadIndex);
+    }
+}
+
+bool ThreadPool::PopLocal(int threadIndex, uint32_t& taskIndex)
+{
+    WorkQueue& queue = *queues[threadIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+    taskIndex = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::Steal(int threadIndex, uint32_t& taskIndex)
+{
+    int threadCount = ThreadCount();
+    for (int offset = 1; offset < threadCount; ++offset)
+    {
+        WorkQueue& victim = *queues[(threadIndex + offset) % threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            taskIndex = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPool& SharedThreadPool(int threadCount)
+{
+    static std::unique_ptr<ThreadPool> pool;
+    static int poolThreadCount = -1;
+    if (!pool || threadCount != poolThreadCount)
+    {
+        pool.reset();
+        pool.reset(new ThreadPool(threadCount));
+        poolThreadCount = threadCount;
+    }
+    return *pool;
+}
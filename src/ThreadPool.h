@@ -0,0 +1,65 @@
+// ThreadPool.h
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads with one task deque per thread. ParallelFor
+// deals contiguous index ranges into the deques; a thread pops from the
+// front of its own deque and, once that is empty, steals from the back of
+// the others. The calling thread takes part as thread 0.
+class ThreadPool
+{
+public:
+    typedef std::function<void(uint32_t taskIndex, int threadIndex)> Task;
+
+    // threadCount <= 0 uses every hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int ThreadCount() const
+    {
+        return static_cast<int>(queues.size());
+    }
+
+    // Runs task for every index in [0, taskCount) and returns when all are done
+    void ParallelFor(uint32_t taskCount, const Task& task);
+
+private:
+    class WorkQueue
+    {
+    public:
+        std::mutex           mutex;
+        std::deque<uint32_t> tasks;
+    };
+
+    void WorkerMain(int threadIndex);
+    void RunTasks(int threadIndex);
+    bool PopLocal(int threadIndex, uint32_t& taskIndex);
+    bool Steal(int threadIndex, uint32_t& taskIndex);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread>                workers;
+    const Task*                             currentTask = nullptr;
+
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t                generation = 0;
+    int                     activeWorkers = 0;
+    bool                    stop = false;
+};
+
+// Process-wide pool shared by the renderers; recreated if the requested
+// thread count changes
+ThreadPool& SharedThreadPool(int threadCount);
@@ -0,0 +1,103 @@
+// Vector3.h
+
+#pragma once
+
+#include <cmath>
+
+const float kPi = 3.1415927f;
+const float kEpsilon = 0.00001f;
+
+class Vector3
+{
+public:
+    Vector3() = default;
+    Vector3(const Vector3& rhs) = default;
+    explicit Vector3(float in)
+        : x(in)
+        , y(in)
+        , z(in)
+    {}
+    Vector3(float inX, float inY, float inZ)
+        : x(inX)
+        , y(inY)
+        , z(inZ)
+    {}
+
+    Vector3& operator=(const Vector3& rhs) = default;
+
+    float Dot(const Vector3& rhs) const
+    {
+        return x * rhs.x + y * rhs.y + z * rhs.z;
+    }
+
+    Vector3 Cross(const Vector3& rhs) const
+    {
+        return { y * rhs.z - z * rhs.y, z * rhs.x - x * rhs.z, x * rhs.y - y * rhs.x };
+    }
+
+    float Length() const
+    {
+        return sqrtf(Dot(*this));
+    }
+
+    Vector3 operator-(const Vector3& rhs) const
+    {
+        return { x - rhs.x, y - rhs.y, z - rhs.z };
+    }
+
+    Vector3 operator+(const Vector3& rhs) const
+    {
+        return { x + rhs.x, y + rhs.y, z + rhs.z };
+    }
+
+    Vector3 operator*(const Vector3& rhs) const
+    {
+        return { x * rhs.x, y * rhs.y, z * rhs.z };
+    }
+
+    Vector3 operator*(float rhs) const
+    {
+        return { x * rhs, y * rhs, z * rhs };
+    }
+
+    Vector3 Normalize() const
+    {
+        return *this * (1.0f / Length());
+    }
+
+    float Distance(const Vector3& rhs)
+    {
+        return (*this - rhs).Length();
+    }
+
+    float x;
+    float y;
+    float z;
+};
+
+template< typename T >
+T Lerp(T val0, T val1, float t)
+{
+    return val0 + (val1 - val0) * t;
+}
+
+inline float Saturate(float in)
+{
+    return in < 0.0f ? 0.0f : in > 1.0f ? 1.0f : in;
+}
+
+inline float Max(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+inline float Min(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+// Rec. 709 luma weights
+inline float Luminance(const Vector3& color)
+{
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
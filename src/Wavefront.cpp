@@ -0,0 +1,241 @@
+// Wavefront.cpp
+//
+// Wavefront integrator. Rather than following each path to the end before
+// starting the next, every stage runs over all live paths of a large batch
+// before the next stage starts: extend (closest hit), shade (sky or surface
+// lighting), shadow (occlusion and throughput update), then the survivors
+// are compacted into the next bounce's queue. Each stage streams only the
+// arrays it needs and works on thousands of rays at once, which keeps the
+// BVH and scene hot in cache even when bounce rays are incoherent.
+
+#include "PathTracer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <vector>
+
+namespace
+{
+
+const uint32_t kBatchSize = 1 << 16; // Paths in flight; bounds memory at large resolutions
+const uint32_t kChunkSize = 1024;    // Paths per thread pool task
+
+// Path state, one entry per slot of the batch
+class PathBatch
+{
+public:
+    explicit PathBatch(size_t size)
+        : pixels(size)
+        , random(size)
+        , rays(size)
+        , hits(size)
+        , found(size)
+        , surfaces(size)
+        , lightSamples(size * kMaxLightSamples)
+        , lightValid(size * kMaxLightSamples)
+        , active(size)
+        , alive(size)
+        , throughput(size)
+        , radiance(size)
+    {
+        queue.reserve(size);
+        nextQueue.reserve(size);
+    }
+
+    std::vector<uint32_t>      pixels;
+    std::vector<Random>        random;
+    std::vector<Ray>           rays;
+    std::vector<HitRecord>     hits;
+    std::vector<uint8_t>       found;
+    std::vector<SurfaceSample> surfaces;
+    std::vector<LightSample>   lightSamples; // kMaxLightSamples per slot
+    std::vector<uint8_t>       lightValid;
+    std::vector<uint8_t>       active; // Pixel still needs samples
+    std::vector<uint8_t>       alive;  // Path continues after this bounce
+    std::vector<Vector3>       throughput;
+    std::vector<Vector3>       radiance;
+
+    std::vector<uint32_t>      queue;     // Slots still tracing this bounce
+    std::vector<uint32_t>      nextQueue;
+};
+
+// Runs stage(first, last) over [0, count) in chunks on the pool. Returns
+// the rays the stage traced.
+template< typename Stage >
+uint64_t RunStage(ThreadPool& pool, uint32_t count, const Stage& stage)
+{
+    std::atomic<uint64_t> rayCount(0);
+    uint32_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    pool.ParallelFor(chunkCount, [&](uint32_t chunk, int)
+    {
+        uint64_t chunkStartRayCount = threadRayCount;
+        uint32_t first = chunk * kChunkSize;
+        uint32_t last = std::min(first + kChunkSize, count);
+        stage(first, last);
+        rayCount += threadRayCount - chunkStartRayCount;
+    });
+    return rayCount;
+}
+
+} // namespace
+
+uint64_t RenderPassWavefront(const Scene& scene, AccumulationBuffer& accumulation, Framebuffer& framebuffer, const RenderSettings& settings, const Vector3& camPos)
+{
+    ThreadPool& pool = SharedThreadPool(settings.threadCount);
+    uint32_t pixelCount = static_cast<uint32_t>(framebuffer.width) * static_cast<uint32_t>(framebuffer.height);
+    uint32_t sampleIndex = accumulation.sampleCount;
+    int lightSampleCount = LightSampleCount(scene, settings);
+
+    PathBatch batch(std::min(kBatchSize, pixelCount));
+    uint64_t rayCount = 0;
+
+    for (uint32_t batchStart = 0; batchStart < pixelCount; batchStart += kBatchSize)
+    {
+        uint32_t batchCount = std::min(kBatchSize, pixelCount - batchStart);
+
+        // Generate: one camera ray per pixel, in scanline order
+        RunStage(pool, batchCount, [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t slot = first; slot < last; ++slot)
+            {
+                uint32_t pixel = batchStart + slot;
+                int i = static_cast<int>(pixel % static_cast<uint32_t>(framebuffer.width));
+                int j = static_cast<int>(pixel / static_cast<uint32_t>(framebuffer.width));
+
+                batch.pixels[slot] = pixel;
+                batch.active[slot] = PixelActive(accumulation, settings, i, j) ? 1 : 0;
+                if (!batch.active[slot])
+                {
+                    continue;
+                }
+
+                float offsetX;
+                float offsetY;
+                batch.random[slot] = PixelRandom(i, j, sampleIndex);
+                PixelSampleOffset(sampleIndex, batch.random[slot], offsetX, offsetY);
+                batch.rays[slot] = { camPos, CameraRayDirection(framebuffer, i, j, offsetX, offsetY) };
+                batch.throughput[slot] = Vector3(1.0f);
+                batch.radiance[slot] = Vector3(0.0f);
+            }
+        });
+
+        batch.queue.clear();
+        for (uint32_t slot = 0; slot < batchCount; ++slot)
+        {
+            if (batch.active[slot])
+            {
+                batch.queue.push_back(slot);
+            }
+        }
+
+        for (int bounce = 0; !batch.queue.empty(); ++bounce)
+        {
+            uint32_t queueCount = static_cast<uint32_t>(batch.queue.size());
+
+            // Extend: closest hit for every live path
+            rayCount += RunStage(pool, queueCount, [&](uint32_t first, uint32_t last)
+            {
+                for (uint32_t entry = first; entry < last; ++entry)
+                {
+                    uint32_t slot = batch.queue[entry];
+                    ++threadRayCount;
+                    batch.found[slot] = TraceRayClosest(batch.rays[slot], scene, batch.hits[slot]) ? 1 : 0;
+                }
+            });
+
+            // Shade: misses pick up the sky, hits compute their lighting and
+            // pick the lights to test
+            RunStage(pool, queueCount, [&](uint32_t first, uint32_t last)
+            {
+                for (uint32_t entry = first; entry < last; ++entry)
+                {
+                    uint32_t slot = batch.queue[entry];
+                    if (bounce == 0)
+                    {
+                        int i = static_cast<int>(batch.pixels[slot] % static_cast<uint32_t>(framebuffer.width));
+                        int j = static_cast<int>(batch.pixels[slot] / static_cast<uint32_t>(framebuffer.width));
+                        RecordFeatures(accumulation, scene, i, j, batch.rays[slot], batch.found[slot] ? &batch.hits[slot] : nullptr);
+                    }
+
+                    if (batch.found[slot])
+                    {
+                        const SurfaceSample& surface = batch.surfaces[slot] = SampleSurface(scene, batch.rays[slot], batch.hits[slot], camPos);
+                        float diffuseWeight = DiffuseWeight(surface, bounce, settings.maxBounces);
+                        for (int i = 0; i < lightSampleCount; ++i)
+                        {
+                            size_t lightSlot = slot * kMaxLightSamples + i;
+                            batch.lightValid[lightSlot] = SampleLocalLight(scene, surface, diffuseWeight, lightSampleCount, batch.random[slot], batch.lightSamples[lightSlot]) ? 1 : 0;
+                        }
+                    }
+                    else
+                    {
+                        batch.radiance[slot] = batch.radiance[slot] + batch.throughput[slot] * SkyCol;
+                    }
+                }
+            });
+
+            // Shadow: key light and light sample occlusion for every hit, then
+            // the bounce ray if the path goes on
+            rayCount += RunStage(pool, queueCount, [&](uint32_t first, uint32_t last)
+            {
+                for (uint32_t entry = first; entry < last; ++entry)
+                {
+                    uint32_t slot = batch.queue[entry];
+                    batch.alive[slot] = 0;
+                    if (!batch.found[slot])
+                    {
+                        continue;
+                    }
+
+                    const SurfaceSample& surface = batch.surfaces[slot];
+                    bool occluded = TraceRayOcclusion({ surface.origin, LightDir }, scene);
+                    for (int i = 0; i < lightSampleCount; ++i)
+                    {
+                        size_t lightSlot = slot * kMaxLightSamples + i;
+                        const LightSample& light = batch.lightSamples[lightSlot];
+                        if (batch.lightValid[lightSlot] && !TraceRayOcclusion({ surface.origin, light.direction }, scene, light.distance))
+                        {
+                            batch.radiance[slot] = batch.radiance[slot] + batch.throughput[slot] * light.contribution;
+                        }
+                    }
+                    if (FinishSurface(surface, occluded, bounce, settings.maxBounces, batch.throughput[slot], batch.radiance[slot]) &&
+                        SampleBounce(surface, settings, batch.random[slot], batch.throughput[slot], batch.rays[slot]) &&
+                        SurviveRoulette(settings, bounce, batch.random[slot], batch.throughput[slot]))
+                    {
+                        batch.alive[slot] = 1;
+                    }
+                }
+            });
+
+            // Compaction is a linear scan over 4-byte slots, cheap next to
+            // the tracing stages, so it stays on the calling thread
+            batch.nextQueue.clear();
+            for (uint32_t slot : batch.queue)
+            {
+                if (batch.alive[slot])
+                {
+                    batch.nextQueue.push_back(slot);
+                }
+            }
+            batch.queue.swap(batch.nextQueue);
+        }
+
+        RunStage(pool, batchCount, [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t slot = first; slot < last; ++slot)
+            {
+                if (!batch.active[slot])
+                {
+                    continue;
+                }
+                int i = static_cast<int>(batch.pixels[slot] % static_cast<uint32_t>(framebuffer.width));
+                int j = static_cast<int>(batch.pixels[slot] / static_cast<uint32_t>(framebuffer.width));
+                framebuffer.SetPixel(i, j, accumulation.Accumulate(i, j, batch.radiance[slot]));
+            }
+        });
+    }
+
+    ++accumulation.sampleCount;
+    return rayCount;
+}